@@ -0,0 +1,63 @@
+#ifndef _EXPRESSION_TREE_H
+#define _EXPRESSION_TREE_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "symachin/Expression.h"
+
+class ExpressionTree;
+typedef std::shared_ptr<ExpressionTree> ExpressionTreePtr;
+
+typedef std::unordered_map<std::string, symachin::ExpressionPtr> LabelMap;
+
+/**
+ * Expression in a statement, as written in the script.
+ * Leaves are either symbols or references to labels,
+ * which are looked up when the tree is evaluated. The
+ * stored expressions of labels are not copied until they
+ * take part in arithmetic. Sums and products are stored
+ * as a single node with all of their operands, so that the
+ * depth of the tree only depends on the nesting of
+ * parentheses, not on the length of the expression.
+ */
+class ExpressionTree {
+    public:
+        enum node_type {
+            CONSTANT,
+            PRODUCT,
+            REFERENCE,
+            SUM,
+            SYMBOL
+        };
+    private:
+        node_type type;
+        std::string text;
+        symachin::ExpressionPtr expr;
+        std::vector<ExpressionTreePtr> operands;
+        std::vector<bool> negated;
+
+        symachin::ExpressionPtr evaluate(const LabelMap&, bool&) const;
+        symachin::ExpressionPtr sum(const LabelMap&, bool&) const;
+        bool write_text(std::string&) const;
+
+        static ExpressionTreePtr constant(const ExpressionTreePtr&, const unsigned int);
+        static ExpressionTreePtr fold(const ExpressionTreePtr&, bool&, const unsigned int);
+    public:
+        ExpressionTree(node_type, const std::string&);
+        ExpressionTree(const symachin::ExpressionPtr&);
+        ExpressionTree(node_type, const std::vector<ExpressionTreePtr>&, const std::vector<bool> &negated=std::vector<bool>());
+
+        symachin::ExpressionPtr Evaluate(const LabelMap&) const;
+        symachin::ExpressionPtr GetExpression() const { return expr; }
+        void GetReferences(std::vector<std::string>&) const;
+        const std::vector<bool>& GetNegated() const { return negated; }
+        const std::vector<ExpressionTreePtr>& GetOperands() const { return operands; }
+        const std::string& GetText() const { return text; }
+        node_type GetType() const { return type; }
+
+        static ExpressionTreePtr Fold(const ExpressionTreePtr&, const unsigned int nthreads=0);
+};
+
+#endif/*_EXPRESSION_TREE_H*/
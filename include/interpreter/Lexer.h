@@ -1,13 +1,39 @@
 #ifndef _LEXER_H
 #define _LEXER_H
 
+#include <cstddef>
+#include <cstring>
+#include <ostream>
 #include <string>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
+/* Text of a token (refers to the source buffer) */
+struct lex_text {
+    const char *data;
+    size_t length;
+
+    lex_text() : data(nullptr), length(0) {}
+    lex_text(const char *d, size_t l) : data(d), length(l) {}
+
+    bool empty() const { return (length == 0); }
+    std::string str() const { return std::string(data, length); }
+    operator std::string() const { return str(); }
+
+    bool operator==(const char *s) const {
+        return (strlen(s) == length && memcmp(data, s, length) == 0);
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& os, const lex_text& t) {
+    return os.write(t.data, t.length);
+}
+
 /* Token structure */
 typedef struct lex_token {
-    std::string text;
-    std::string filename;
+    lex_text text;
+    const std::string *filename;
     long charpos, line;
 
     /* Token types */
@@ -15,7 +41,6 @@ typedef struct lex_token {
         UNKNOWN,            // Unknown token type
         ENDOFSTREAM,        // End-of-token-stream
 
-        EXPRESSION,         // Expression (containing multiple words and operators)
         WORD,               // A single word
         LABEL,              // [???]
         REFERENCE,          // $???
@@ -36,6 +61,8 @@ typedef struct lex_token {
         DEFINE,             // define
         END,                // end
         EVAL,               // eval
+        EXPORT,             // export
+        FREE,               // free
         GROUP,              // group
         IN,                 // in
         INCLUDE,            // include
@@ -44,28 +71,18 @@ typedef struct lex_token {
         PRINTF,             // printf
         PRINTN,             // printn
         REPLACE,            // replace
+        SUBSTITUTE,         // substitute
         TO,                 // to
-        WITH                // with
+        WITH,               // with
+        WRT                 // wrt
     };
     tok_type type;
 
-    struct lex_token *Copy() {
-        struct lex_token *lt = new struct lex_token;
-
-        lt->text = text;
-        lt->filename = filename;
-        lt->charpos = charpos;
-        lt->line = line;
-        lt->type = type;
-
-        return lt;
-    };
     std::string ToString() {
-        return ToString(type) + "(" + text + ")";
+        return ToString(type) + "(" + text.str() + ")";
     };
     static std::string ToString(tok_type t) {
         switch (t) {
-            case EXPRESSION:     return "EXPRESSION";
             case WORD:           return "WORD";
             case LABEL:          return "LABEL";
             case REFERENCE:      return "REFERENCE";
@@ -86,6 +103,8 @@ typedef struct lex_token {
             case DEFINE:         return "DEFINE";
             case END:            return "END";
             case EVAL:           return "EVAL";
+            case EXPORT:         return "EXPORT";
+            case FREE:           return "FREE";
             case GROUP:          return "GROUP";
             case IN:             return "IN";
             case INCLUDE:        return "INCLUDE";
@@ -94,8 +113,10 @@ typedef struct lex_token {
             case PRINTF:         return "PRINTF";
             case PRINTN:         return "PRINTN";
             case REPLACE:        return "REPLACE";
+            case SUBSTITUTE:     return "SUBSTITUTE";
             case TO:             return "TO";
             case WITH:           return "WITH";
+            case WRT:            return "WRT";
 
             case ENDOFSTREAM:    return "ENDOFSTREAM";
             case UNKNOWN:
@@ -109,23 +130,47 @@ typedef token::tok_type ttype;
 /* Lexer class */
 class Lexer {
     private:
+        // State of reading one source buffer
+        struct lex_state {
+            const char *buffer;
+            long bufcount, buflen;
+            const std::string *filename;
+            long charpos, line;
+            char current;
+        };
+
         // Properties
-        std::string buffer;
-        long bufcount, buflen;
-        std::string filename;
-        long charpos, line;
+        const char *buffer = nullptr;
+        long bufcount = 0, buflen = 0;
+        const std::string *filename = nullptr;
+        long charpos = 0, line = 0;
+        char current = 0;
+
+        // Sources being read (from including files)
+        std::vector<lex_state> includes;
+        // Mapped files and copied strings, kept until
+        // the lexer is destroyed since tokens refer to them
+        std::vector<std::pair<void*, size_t>> mappings;
+        std::vector<std::string*> strings;
+        // Interned file names
+        std::unordered_set<std::string> filenames;
+        // Files read, in the order they were opened
+        std::vector<std::string> files;
 
         // Internal routines
-        void back();
         char cchar();
         char gchar();
         ttype is_operator(const char) const;
-        token *next();
+        bool next(token&);
         char peek() const;
+        void push(const char*, size_t, const std::string&);
     public:
-        std::vector<token*> *Lex(std::string&, const std::string&, std::vector<token*> *tokens=nullptr);
-        std::vector<token*> *LexFile(const std::string&, std::vector<token*> *tokens=nullptr);
-        std::vector<token*> *IncludeFile(const std::string&, std::vector<token*> *tokens=nullptr);
+        ~Lexer();
+
+        const std::vector<std::string>& GetFiles() const { return files; }
+        void Load(const std::string&, const std::string&);
+        void LoadFile(const std::string&);
+        bool Next(token&);
 
         void Error(const std::string&);
 };
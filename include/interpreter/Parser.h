@@ -1,69 +1,153 @@
 #ifndef _PARSER_H
 #define _PARSER_H
 
+#include <deque>
+#include <iostream>
 #include <string>
 #include <map>
+#include <mutex>
+#include <ostream>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 #include "symachin/Expression.h"
+#include "symachin/NativeExpression.h"
 #include "symachin/Operators/Replace.h"
+#include "symachin/Operators/Substitute.h"
 
+#include "interpreter/ExpressionTree.h"
 #include "interpreter/Lexer.h"
 #include "interpreter/ParserException.h"
+#include "interpreter/Statement.h"
+#include "interpreter/Thunk.h"
 
 class Parser {
     private:
-        std::unordered_map<std::string, symachin::ExpressionPtr> expressions;
+        LabelMap expressions;
         std::unordered_map<std::string, symachin::ReplacePtr> rules;
+        std::unordered_map<uint64_t, symachin::NativeExpressionPtr> natives;
+        // Labels in lazy mode
+        ThunkMap thunks;
+        // Guards the labels, rules, compiled expressions and
+        // statistics when statements are executed in parallel
+        mutable std::mutex lock;
 
-        std::vector<token*> *tokenlist;
-        unsigned long tknindex;
+        // Tokens are read from the lexer as they are needed
+        Lexer *lexer = nullptr;
+        mutable std::deque<token> lookahead;
+        token last;
+        bool hasLast = false;
 
         std::string currentlabel;
 
-        token endtkn = { "", "", 0, 0, token::ENDOFSTREAM };
+        // Labels defined by the statements read so far
+        std::unordered_set<std::string> defined;
+        // Interned names of script files
+        std::unordered_set<std::string> filenames;
+
+        // Position of the statement being executed on
+        // this thread, and the stream its output goes to
+        static thread_local token position;
+        static thread_local bool executing;
+        static thread_local std::ostream *output;
+        // Values of the thunk being evaluated on this thread
+        static thread_local LabelMap *thunkValues;
+
+        // Settings
+        bool exactAssert = true;
+        unsigned int assertPoints = 2;
+        bool modular = false;
+        unsigned int nthreads = 0;
+        bool jit = false;
+        std::string jitCache;
+        bool scriptCache = false;
+        bool parallel = false;
+        bool lazy = false;
+        bool freeLabels = false;
+        bool verbose = false;
+
+        // Statistics
+        unsigned int nAsserts = 0, nFailedAsserts = 0;
+
+        static const std::string emptyFilename;
+        token endtkn = { lex_text(), &emptyFilename, 0, 0, token::ENDOFSTREAM };
 
         // Internal routines
         token *advance();
         ttype expect(ttype);
-        ttype expect_expression(ttype t=token::ENDSTATEMENT);
+        void declare(const Statement&);
+        bool defer(Statement&);
+        void drop(const std::string&, LabelMap&);
+        void execute(Statement&);
+        void execute(std::vector<StatementPtr>&);
+        ExpressionTreePtr expression(ttype t=token::ENDSTATEMENT);
+        ExpressionTreePtr expression_factor();
+        ExpressionTreePtr expression_product();
+        ExpressionTreePtr expression_sum();
+        token *errtkn() const;
+        bool fill(unsigned long) const;
+        symachin::ReplacePtr find_rule(const std::string&);
+        void free_dead(std::vector<StatementPtr>&) const;
+        void evaluate_thunk(const ThunkPtr&);
+        symachin::ExpressionPtr force(const ThunkPtr&, const std::string&);
         token *gtkn() const;
         bool is_number(const std::string&) const;
-        ttype peek() const;
+        symachin::NativeExpressionPtr native(symachin::ExpressionPtr&);
+        ttype peek(unsigned long ahead=0) const;
         void require_label() const;
+        void run(Statement&, LabelMap&, symachin::ReplacePtr&);
+        StatementPtr statement();
+        void statements(Lexer&, std::vector<StatementPtr>&);
 
         // Commands
-        void apply_to(const std::string&, const std::string&, symachin::ExpressionPtr&);
+        void apply_to(const std::string&, symachin::ReplacePtr&, symachin::ExpressionPtr&);
         void assert(symachin::ExpressionPtr&, symachin::ExpressionPtr&);
         void assign(const std::string&, symachin::ExpressionPtr&);
         void define(const std::string&, symachin::ReplacePtr&);
-        void evaluate(symachin::ExpressionPtr&, std::map<std::string, double>&, double);
+        void evaluate(symachin::ExpressionPtr&, std::map<std::string, double>&, double, const std::vector<std::string>&);
         void evaluate_assert(symachin::ExpressionPtr&, double, std::map<std::string, double>&, double);
+        void export_c(const std::string&, const std::vector<std::string>&, const std::string&, const LabelMap&);
+        void evaluate_table(symachin::ExpressionPtr&, const std::string&, const std::string&, const std::vector<std::string>&);
         //void group_by(symachin::ExpressionPtr&, std::vector<symachin::FactorPtr>&, std::vector<std::string>&, const std::string&);
         void group_by(symachin::ExpressionPtr&, std::vector<symachin::ExpressionPtr>&, std::vector<std::string>&, const std::string&);
-        void print();
+        void print(const std::vector<ExpressionTreePtr>&, const LabelMap&);
+        void release(const std::vector<std::string>&);
         void printf(symachin::ExpressionPtr&);
         void printn(symachin::ExpressionPtr&);
-        void replace_in(const std::string&, const std::string&, const std::string&, symachin::ExpressionPtr);
+        void replace_in(const std::string&, const std::string&, symachin::ExpressionPtr&, symachin::ExpressionPtr&);
+        void substitute(const std::string&, symachin::ExpressionPtr&, symachin::SubstitutePtr&);
 
         template<typename ... Args>
         ttype expect(ttype t, Args... args) {
-            if (tknindex >= tokenlist->size())
+            ttype p = peek();
+            if (p == token::ENDOFSTREAM)
                 Error("Unexpected end of token stream.");
-            token *tkn = tokenlist->at(tknindex);
 
-            if (tkn->type == t) {
-                tknindex++;
-                return tkn->type;
+            if (p == t) {
+                advance();
+                return p;
             } else
                 return expect(args...);
         };
     public:
-        void LoadTokens(std::vector<token*>*);
+        void SetAssertPoints(unsigned int n) { assertPoints = n; }
+        void SetExactAssert(bool exact) { exactAssert = exact; }
+        void SetFreeLabels(bool f) { freeLabels = f; }
+        void SetJIT(bool j) { jit = j; }
+        void SetJITCache(const std::string& dir) { jitCache = dir; }
+        void SetLazy(bool l) { lazy = l; }
+        void SetModular(bool);
+        void SetParallel(bool p) { parallel = p; }
+        void SetScriptCache(bool c) { scriptCache = c; }
+        void SetThreads(unsigned int n) { nthreads = n; }
+        void SetVerbose(bool v) { verbose = v; }
+
+        unsigned int GetNumberOfAsserts() const { return nAsserts; }
+        unsigned int GetNumberOfFailedAsserts() const { return nFailedAsserts; }
 
         void Parse(std::string&);
-        void Parse(std::vector<token*>*);
+        void Parse(Lexer&);
         void ParseFile(const std::string&);
 
         /**
@@ -71,19 +155,44 @@ class Parser {
          */
         template<typename ... Args>
         void Error(const std::string& msg, Args&& ... args) const {
-            token *tkn;
-            if (tknindex > 1 && tknindex < tokenlist->size())
-                tkn = tokenlist->at(tknindex-1);
-            else if (tknindex == 0)
-                tkn = tokenlist->front();
-            else
-                tkn = tokenlist->back();
-
+            token *tkn = errtkn();
             throw ParserException(
                 "%s: line %d:%d: "+msg,
-                tkn->filename.c_str(), tkn->line, tkn->charpos,
+                tkn->filename->c_str(), tkn->line, tkn->charpos,
+                std::forward<Args>(args) ...
+            );
+        };
+
+        /**
+         * Report a problem in the parser without
+         * interrupting execution.
+         */
+        template<typename ... Args>
+        void Warning(const std::string& msg, Args&& ... args) const {
+            token *tkn = errtkn();
+            ParserException ex(
+                "%s: line %d:%d: "+msg,
+                tkn->filename->c_str(), tkn->line, tkn->charpos,
+                std::forward<Args>(args) ...
+            );
+
+            *output << "WARNING: " << ex.whats() << std::endl;
+        };
+
+        /**
+         * Report additional information about the
+         * statement being executed.
+         */
+        template<typename ... Args>
+        void Note(const std::string& msg, Args&& ... args) const {
+            token *tkn = errtkn();
+            ParserException ex(
+                "%s: line %d:%d: "+msg,
+                tkn->filename->c_str(), tkn->line, tkn->charpos,
                 std::forward<Args>(args) ...
             );
+
+            *output << "NOTE: " << ex.whats() << std::endl;
         };
 };
 
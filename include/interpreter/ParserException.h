@@ -1,5 +1,5 @@
-#ifndef _LEXER_EXCEPTION_H
-#define _LEXER_EXCEPTION_H
+#ifndef _PARSER_EXCEPTION_H
+#define _PARSER_EXCEPTION_H
 
 #include <string>
 #include <utility>
@@ -15,4 +15,4 @@ class ParserException : public SymachinException {
 		ParserException(const std::string& msg, Args&& ... args) : SymachinException(msg, std::forward<Args>(args) ...) {}
 };
 
-#endif/*_LEXER_EXCEPTION_H*/
+#endif/*_PARSER_EXCEPTION_H*/
@@ -0,0 +1,65 @@
+#ifndef _SCHEDULER_H
+#define _SCHEDULER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <queue>
+#include <string>
+#include <vector>
+#include "interpreter/Statement.h"
+
+/**
+ * Executes the statements of a script on a pool of
+ * threads. Each statement waits for the statements
+ * before it which define a label or rule it uses, which
+ * use a label or rule it redefines, or which redefine the
+ * same label or rule. Statements writing to files wait for
+ * all statements before them. Everything else may run
+ * concurrently.
+ *
+ * The output of each statement is buffered, and written
+ * to the output stream in the order of the statements, so
+ * that the output is the same as if the statements were
+ * executed one after the other. If a statement fails, no
+ * statements after it are started, and the error of the
+ * first failed statement is rethrown once the statements
+ * before it have finished.
+ */
+class Scheduler {
+    public:
+        // Function executing a statement, writing
+        // its output to the given stream
+        typedef std::function<void(Statement&, std::ostream&)> task;
+    private:
+        const std::vector<StatementPtr> &stmts;
+        task run;
+        std::ostream &out;
+        unsigned int nthreads;
+
+        // Dependency graph
+        std::vector<std::vector<size_t>> successors;
+        std::vector<size_t> npredecessors;
+
+        // Execution state
+        std::mutex lock;
+        std::condition_variable cond;
+        std::priority_queue<size_t, std::vector<size_t>, std::greater<size_t>> ready;
+        std::vector<std::string> outputs;
+        std::vector<std::exception_ptr> errors;
+        std::vector<bool> done;
+        size_t committed = 0, running = 0, failed;
+
+        void build();
+        void complete(const size_t, const std::string&, std::exception_ptr);
+        void work();
+    public:
+        Scheduler(const std::vector<StatementPtr>&, task, std::ostream&, unsigned int nthreads=0);
+
+        void Run();
+};
+
+#endif/*_SCHEDULER_H*/
@@ -0,0 +1,58 @@
+#ifndef _SCRIPT_CACHE_H
+#define _SCRIPT_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "symachin/Expression.h"
+#include "interpreter/ExpressionTree.h"
+#include "interpreter/Statement.h"
+
+/**
+ * Cache of the parsed statements of a script, stored
+ * next to the script in a binary file. The cache is
+ * only used if none of the files making up the script
+ * (the script itself and all files it includes) has
+ * changed since the cache was written.
+ */
+class ScriptCache {
+    private:
+        std::string script, cachefile;
+
+        // Source files of the script
+        std::vector<const std::string*> sources;
+        std::unordered_map<std::string, uint32_t> sourceIndex;
+
+        std::ifstream in;
+        std::ofstream out;
+        uint64_t left = 0;
+
+        void read(void*, size_t);
+        template<typename T> T read() { T v; read(&v, sizeof(v)); return v; }
+        symachin::ExpressionPtr read_expression();
+        StatementPtr read_statement();
+        std::string read_string();
+        ExpressionTreePtr read_tree();
+
+        void write(const void*, size_t);
+        template<typename T> void write(const T v) { write(&v, sizeof(v)); }
+        void write_expression(const symachin::Expression&);
+        void write_statement(const Statement&);
+        void write_string(const std::string&);
+        void write_tree(const ExpressionTreePtr&);
+    public:
+        ScriptCache(const std::string&);
+
+        const std::string& GetCacheFile() const { return cachefile; }
+
+        bool Load(std::vector<StatementPtr>&, std::unordered_set<std::string>&);
+        void Save(const std::vector<std::string>&, const std::vector<StatementPtr>&);
+
+        static bool HashFile(const std::string&, uint64_t*, uint64_t*);
+};
+
+#endif/*_SCRIPT_CACHE_H*/
@@ -0,0 +1,91 @@
+#ifndef _STATEMENT_H
+#define _STATEMENT_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "symachin/Operators/Substitute.h"
+#include "interpreter/ExpressionTree.h"
+
+class Statement;
+typedef std::shared_ptr<Statement> StatementPtr;
+
+/**
+ * A statement of a script, as read by the parser.
+ * Statements do not refer to the tokens they were read
+ * from, and labels are referred to by name, so that a
+ * statement can be executed after the lexer is gone.
+ *
+ * The meaning of the operands depends on the type:
+ *
+ *   APPLY        names = { rule }, expressions = { expr }
+ *   ASSERT       expressions = { lhs, rhs }
+ *   ASSIGN       expressions = { expr }
+ *   DEFINE       names[i] -> expressions[i]
+ *   EVAL         expressions = { expr }, values, otherValue, wrt
+ *   EVAL_ASSERT  expressions = { expr }, values, otherValue, expected
+ *   EVAL_TABLE   expressions = { expr }, input, output, wrt
+ *   EXPORT       names = { labels... }, output
+ *   FREE         names = { labels... }
+ *   GROUP        expressions = { expr, by... }, names = { sublabels... }, otherLabel
+ *   PRINT        expressions = { symbols and references to print }
+ *   PRINTF       expressions = { expr }
+ *   PRINTN       expressions = { expr }
+ *   REPLACE      names = { factor }, expressions = { replacement, expr }
+ *   SUBSTITUTE   expressions = { expr }, substitute
+ */
+class Statement {
+    public:
+        enum statement_type {
+            APPLY,
+            ASSERT,
+            ASSIGN,
+            DEFINE,
+            EVAL,
+            EVAL_ASSERT,
+            EVAL_TABLE,
+            EXPORT,
+            FREE,
+            GROUP,
+            PRINT,
+            PRINTF,
+            PRINTN,
+            REPLACE,
+            SUBSTITUTE
+        };
+
+        statement_type type;
+        // Label assigned to (empty if none)
+        std::string label;
+        // Position of the end of the statement in the script
+        const std::string *filename = nullptr;
+        long line = 0, charpos = 0;
+
+        std::vector<ExpressionTreePtr> expressions;
+        std::vector<std::string> names;
+
+        // EVAL
+        std::map<std::string, double> values;
+        double otherValue = 1.0, expected = 0.0;
+        std::vector<std::string> wrt;
+        std::string input;
+
+        // EVAL_TABLE and EXPORT
+        std::string output;
+
+        // GROUP
+        std::string otherLabel;
+
+        // SUBSTITUTE
+        symachin::SubstitutePtr substitute;
+
+        Statement(statement_type t, const std::string &lbl) : type(t), label(lbl) {}
+
+        std::vector<std::string> GetInputs() const;
+        std::vector<std::string> GetOutputs() const;
+        bool HasExternalEffects() const;
+        bool IsUpdate() const;
+};
+
+#endif/*_STATEMENT_H*/
@@ -0,0 +1,38 @@
+#ifndef _TABLE_H
+#define _TABLE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * Table of numeric values with named columns. The values
+ * are stored column by column.
+ */
+class Table {
+    private:
+        std::vector<std::string> names;
+        std::vector<std::vector<double>> columns;
+        size_t nrows=0;
+        bool binary=false;
+
+        void read_binary(const std::string&);
+        void read_csv(const std::string&);
+        void write_binary(const std::string&) const;
+        void write_csv(const std::string&) const;
+    public:
+        Table(const size_t nrows=0, bool binary=false);
+
+        std::vector<double>& AddColumn(const std::string&);
+        const std::vector<double> *GetColumn(const std::string&) const;
+        const std::vector<std::string>& GetColumnNames() const { return names; }
+        bool IsBinary() const { return binary; }
+        size_t NumberOfRows() const { return nrows; }
+
+        void Read(const std::string&);
+        void Write(const std::string&) const;
+
+        static bool IsCSVFile(const std::string&);
+};
+
+#endif/*_TABLE_H*/
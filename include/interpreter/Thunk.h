@@ -0,0 +1,43 @@
+#ifndef _THUNK_H
+#define _THUNK_H
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "symachin/Operators/Replace.h"
+#include "interpreter/ExpressionTree.h"
+#include "interpreter/Statement.h"
+
+class Thunk;
+typedef std::shared_ptr<Thunk> ThunkPtr;
+typedef std::unordered_map<std::string, ThunkPtr> ThunkMap;
+
+/**
+ * The pending values of the labels defined by a statement,
+ * used when labels are evaluated lazily. The thunk holds on
+ * to the labels (and rule) used by the statement as they
+ * were when the statement was read, so that redefining them
+ * afterwards does not change its values. The statement is
+ * executed the first time one of its labels is needed.
+ */
+class Thunk {
+    public:
+        // Statement computing the values
+        Statement statement;
+        // Labels and rule used by the statement (released
+        // once the statement has been executed)
+        ThunkMap inputs;
+        symachin::ReplacePtr rule;
+
+        // Values of the labels defined by the statement
+        LabelMap values;
+        bool evaluated = false;
+
+        std::mutex lock;
+
+        Thunk(const Statement &st) : statement(st) {}
+        ~Thunk();
+};
+
+#endif/*_THUNK_H*/
@@ -0,0 +1,47 @@
+#ifndef _SYMACHIN_CODE_GENERATOR_H
+#define _SYMACHIN_CODE_GENERATOR_H
+
+#include <map>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "symachin/Expression.h"
+#include "symachin/HornerPlanner.h"
+
+namespace symachin {
+    class CodeGenerator {
+        private:
+            struct output {
+                std::string name;
+                std::vector<double> coefficients;
+                std::vector<monomial> monomials;
+            };
+
+            std::string funcname;
+            std::vector<output> outputs;
+
+            // Symbol table
+            std::vector<std::string> symbols;
+            std::unordered_map<std::string, unsigned int> slots;
+            std::vector<std::string> cnames;
+
+            void assign_cnames();
+            std::string cname(const std::string&, std::map<std::string, unsigned int>&) const;
+            void generate_straight(std::ostringstream&, const output&, const std::string&) const;
+            void generate_table(std::ostringstream&, const output&, unsigned int, const std::string&, const std::vector<unsigned int>&) const;
+        public:
+            // Sums with more terms than this are evaluated
+            // in loops over tables of coefficients
+            static const unsigned int TABLE_THRESHOLD = 128;
+
+            CodeGenerator(const std::string&);
+
+            void Add(const std::string&, const Expression&);
+            std::string Generate();
+            const std::vector<std::string>& GetSymbols() const { return symbols; }
+            unsigned int NumberOfOutputs() const { return outputs.size(); }
+    };
+}
+
+#endif/*_SYMACHIN_CODE_GENERATOR_H*/
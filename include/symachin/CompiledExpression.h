@@ -0,0 +1,70 @@
+#ifndef _SYMACHIN_COMPILED_EXPRESSION_H
+#define _SYMACHIN_COMPILED_EXPRESSION_H
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "symachin/Expression.h"
+#include "symachin/HornerPlanner.h"
+
+namespace symachin {
+    class CompiledExpression;
+    typedef std::shared_ptr<CompiledExpression> CompiledExpressionPtr;
+
+    class CompiledExpression {
+        private:
+            // Symbol table
+            std::vector<std::string> symbols;
+            std::unordered_map<std::string, unsigned int> slots;
+
+            // Program
+            std::vector<eval_op> ops;
+            unsigned int nregisters=0, outputRegister=0;
+            unsigned int nterms=0;
+
+            void evaluate_range(const double *const*, const size_t, const size_t, double*) const;
+            void evaluate_gradient_range(
+                const double *const*, const size_t, const size_t,
+                const std::vector<unsigned int>*, double*, double *const*
+            ) const;
+        public:
+            static const unsigned int NO_SLOT = (unsigned int)-1;
+            static const unsigned int BLOCK_SIZE = 128;
+
+            CompiledExpression(const Expression&);
+            CompiledExpression(const Expression&, const std::map<std::string, double>&);
+            ~CompiledExpression();
+
+            std::vector<double> Bind(const std::map<std::string, double>&, const double other=1.0) const;
+            double Evaluate(const double*) const;
+            double Evaluate(const std::vector<double>& v) const { return Evaluate(v.data()); }
+            double Evaluate(const std::map<std::string, double>&, const double other=1.0) const;
+            void Evaluate(const double *const*, const size_t, double*, unsigned int nthreads=0) const;
+            double EvaluateGradient(const double*, const std::vector<unsigned int>&, double*) const;
+            void EvaluateGradient(
+                const double *const*, const size_t, const std::vector<unsigned int>&,
+                double*, double *const*, unsigned int nthreads=0
+            ) const;
+
+            const std::vector<eval_op>& GetOperations() const { return ops; }
+            unsigned int GetOutputRegister() const { return outputRegister; }
+            unsigned int GetSlot(const std::string&) const;
+            const std::vector<std::string>& GetSymbols() const { return symbols; }
+            unsigned int NumberOfMultiplications() const;
+            unsigned int NumberOfRegisters() const { return nregisters; }
+            unsigned int NumberOfSymbols() const { return symbols.size(); }
+            unsigned int NumberOfTerms() const { return nterms; }
+
+            static void Decompose(
+                const Expression&, std::vector<std::string>&,
+                std::unordered_map<std::string, unsigned int>&,
+                std::vector<double>&, std::vector<monomial>&,
+                const std::map<std::string, double> *fixed=nullptr
+            );
+    };
+}
+
+#endif/*_SYMACHIN_COMPILED_EXPRESSION_H*/
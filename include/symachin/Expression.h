@@ -1,9 +1,12 @@
 #ifndef _SYMACHIN_EXPRESSION_H
 #define _SYMACHIN_EXPRESSION_H
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <vector>
 #include "symachin/Factor.h"
+#include "symachin/PackedMonomial.h"
 #include "symachin/Term.h"
 
 namespace symachin {
@@ -14,22 +17,71 @@ namespace symachin {
     class Expression {
         private:
             vectorTermPtr terms=nullptr;
+            // Numeric coefficient (with sign) and packed
+            // monomial of each term
+            std::vector<long long> coefficients;
+            std::vector<PackedMonomial> monomials;
+            uint64_t fingerprint=0;
+
+            static const uint64_t FINGERPRINT_SEED;
+
+            // Dense multiplication (see 'multiply_dense()') is
+            // used when all terms of both operands pack into a
+            // 'PackedMonomial' (i.e. when the operands involve
+            // at most 'PackedMonomial::MAX_SYMBOLS' symbols
+            // together, with exponents of at most
+            // 'PackedMonomial::MAX_EXPONENT'), there are at least
+            // 'DENSE_MIN_PRODUCTS' products of terms, and the
+            // array of coefficients, with one entry for every
+            // monomial of the product's bounding box, has at
+            // most 'DENSE_MAX_SIZE' entries and at most
+            // 'DENSE_MAX_FILL' entries per product. The last
+            // bound keeps the time spent clearing and scanning
+            // the array within a constant factor of the time
+            // spent on the products, and the first keeps the
+            // array (about 25 bytes per entry) in cache. Below
+            // 'DENSE_MIN_PRODUCTS', the sparse search is as fast.
+            // The dense path still forms all n1*n2 products, in
+            // the same order as the sparse one: it only makes
+            // finding the term a product merges with O(1).
+            static const size_t DENSE_MAX_SIZE = 1 << 16;
+            static const size_t DENSE_MIN_PRODUCTS = 64;
+            static const size_t DENSE_MAX_FILL = 4;
+
+            void append(const TermPtr&, const long long, const PackedMonomial&);
+            bool merge(const Term&, const long long, const PackedMonomial&);
+            void update_columns();
+
+            static long long coefficient(const Term&);
+            static bool merge(vectorTermPtr, const Term&);
+            static vectorTermPtr multiply_dense(
+                const std::vector<TermPtr>&, const std::vector<TermPtr>&,
+                const std::vector<PackedMonomial>&, const std::vector<PackedMonomial>&
+            );
         public:
             Expression();
             Expression(Term&);
             Expression(vectorTermPtr);
             Expression(const std::string&);
+            Expression(const Expression&);
             ~Expression();
 
+            uint64_t Fingerprint() const { return fingerprint; }
+            const std::vector<long long>& GetCoefficients() const { return coefficients; }
             vectorTermPtr GetTerms() const { return terms; }
             vectorTermPtr MoveTerms();
+            void SetTerms(vectorTermPtr);
+            void UpdateFingerprint();
             bool HasTerm(const Term&) const;
-            bool IsEqual(Expression&) const;
+            bool IsEqual(const Expression&) const;
+            bool IsEqualRandomized(const Expression&, const unsigned int npoints=2, double *errprob=nullptr) const;
             bool IsZero() const;
             void Negate();
             unsigned int NumberOfTerms() const { return terms->size(); }
+            unsigned int Degree() const;
 
             double Evaluate(const std::map<std::string, double>&, const double other=1.0) const;
+            uint64_t EvaluateModular(const uint64_t) const;
 
             void Add(Factor&);
             void Add(Term&);
@@ -48,6 +100,7 @@ namespace symachin {
             void Multiply(const std::string&);
 
             static void Add(vectorTermPtr, const Term&);
+            static void Add(vectorTermPtr, const TermPtr&);
             static vectorTermPtr Multiply(const std::vector<TermPtr>&, const std::vector<TermPtr>&);
             static vectorTermPtr Multiply(const Term&, const std::vector<TermPtr>&);
             static vectorTermPtr Multiply(const std::vector<TermPtr>&, const Term&);
@@ -62,6 +115,18 @@ namespace symachin {
 
             long CountMaxUsage();
     };
+
+    /**
+     * Hash and equality functors for using expressions
+     * as keys in unordered containers, e.g.
+     *   std::unordered_map<ExpressionPtr, T, ExpressionHash, ExpressionEqual>
+     */
+    struct ExpressionHash {
+        size_t operator()(const ExpressionPtr &e) const { return e->Fingerprint(); }
+    };
+    struct ExpressionEqual {
+        bool operator()(const ExpressionPtr &a, const ExpressionPtr &b) const { return a->IsEqual(*b); }
+    };
 }
 
 #endif/*_SYMACHIN_EXPRESSION_H*/
@@ -1,46 +1,54 @@
 #ifndef _SYMACHIN_EXPRESSION_PARSER_H
 #define _SYMACHIN_EXPRESSION_PARSER_H
 
+#include <cstddef>
 #include <string>
 #include <vector>
+#include "symachin/Expression.h"
+#include "symachin/Term.h"
+#include "symachin/TermAccumulator.h"
 
 namespace symachin {
-    enum intp_ttype {
-        SYMACHIN_TTYPE_OPERATOR,
-        SYMACHIN_TTYPE_LPAR,
-        SYMACHIN_TTYPE_RPAR,
-        SYMACHIN_TTYPE_SYMBOL
-    };
-    struct intp_token {
-        enum intp_ttype type;
-        int precedence;
-        std::string text;
-    };
-
     class ExpressionParser {
         private:
-            std::string *buffer;
-            int bufindx=-1;
-
-            std::vector<struct intp_token*> operator_stack;
-            std::vector<struct intp_token*> symbol_stack;
-            std::vector<struct intp_token*> output_queue;
+            enum token_type {
+                END,
+                LPAR,
+                MINUS,
+                MULTIPLICATION,
+                PLUS,
+                RPAR,
+                SYMBOL
+            };
+
+            // Smallest chunk handed to a thread when
+            // parsing in parallel (in characters)
+            static const size_t PARALLEL_CHUNK_SIZE = 1 << 20;
+
+            unsigned int nthreads;
+
+            // Input
+            const char *pos=nullptr, *end=nullptr;
+
+            // Current token
+            token_type tkn=END;
+            const char *tknbegin=nullptr;
+            size_t tknlength=0;
 
             // Internal functions
-            bool eoe() const;
-            bool is_ignoreable(char) const;
-            int is_operator(char) const;
-            enum intp_ttype is_parenthesis(char) const;
-            struct intp_token *next();
+            void next();
+            vectorTermPtr parse(const char*, const size_t, std::vector<TermPtr> *unmerged=nullptr);
+            vectorTermPtr parse_parallel(const char*, const size_t, const unsigned int);
+            vectorTermPtr parse_product();
+            vectorTermPtr parse_sum(std::vector<TermPtr> *unmerged=nullptr);
+            std::vector<const char*> split(const char*, const size_t, const unsigned int) const;
         public:
-            ExpressionParser();
+            ExpressionParser(unsigned int nthreads=0);
 
             ExpressionPtr Parse(const std::string&);
             ExpressionPtr Parse(const std::string*);
-
-            ExpressionPtr ParsePostfix();
-            void PreProcessBuffer();
-            void ToPostfix();
+            ExpressionPtr Parse(const char*, const size_t);
+            vectorTermPtr ParseTerms(const char*, const size_t);
     };
 }
 
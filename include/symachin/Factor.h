@@ -1,6 +1,7 @@
 #ifndef _SYMACHIN_FACTOR_H
 #define _SYMACHIN_FACTOR_H
 
+#include <cstddef>
 #include <memory>
 #include <string>
 #include <vector>
@@ -22,16 +23,24 @@ namespace symachin {
             enum sign sgn;
 
             bool isNumeric;
-            int numericValue;
+            long long numericValue;
+
+            // Index of the symbol (see 'Intern()')
+            unsigned int index;
+
+            static bool modularArithmetic;
         public:
+            static const unsigned int NO_INDEX = (unsigned int)-1;
+
             Factor(const std::string&, enum sign s=SYMACHIN_SIGN_POS);
             Factor(const Factor&);
             ~Factor();
 
-            std::string GetName() const { return name; }
-            int GetNumericValue() const { return numericValue; }
-            int GetNumericValue(const std::string&, enum sign, bool withsign=true) const;
-            int GetNumericValue(const Factor&, bool withsign=true) const;
+            unsigned int GetIndex() const { return index; }
+            const std::string& GetName() const { return name; }
+            long long GetNumericValue() const { return numericValue; }
+            long long GetNumericValue(const std::string&, enum sign, bool withsign=true) const;
+            long long GetNumericValue(const Factor&, bool withsign=true) const;
             enum sign GetSign() const { return sgn; }
             bool IsNumber() const { return isNumeric; }
             bool IsNumber(const std::string&) const;
@@ -40,11 +49,21 @@ namespace symachin {
             vectorFactorPtr Multiply(const Factor&) const;
             void MultiplyNumeric(const Factor&);
             void Negate();
+            void SetNumericValue(const long long);
             bool IsEqual(const Factor&) const;
 
             std::string ToString() const;
 
             bool operator==(const Factor &f) const { return IsEqual(f); }
+
+            static FactorPtr Intern(const Factor&);
+            static FactorPtr Intern(const char*, const size_t, enum sign s=SYMACHIN_SIGN_POS);
+            static void Unshare(FactorPtr&);
+
+            static bool IsModularArithmetic() { return modularArithmetic; }
+            static void SetModularArithmetic(bool m) { modularArithmetic = m; }
+            static long long NumericProduct(const long long, const long long);
+            static long long NumericSum(const long long, const long long);
     };
 }
 
@@ -0,0 +1,40 @@
+#ifndef _SYMACHIN_FINITE_FIELD_H
+#define _SYMACHIN_FINITE_FIELD_H
+
+#include <cstdint>
+#include <string>
+
+namespace symachin {
+    /**
+     * Arithmetic in the prime field Z/pZ with the
+     * Mersenne prime p = 2^61 - 1. Elements are stored
+     * as unsigned 64-bit integers in the range [0, p).
+     */
+    class FiniteField {
+        public:
+            static const uint64_t PRIME = 0x1FFFFFFFFFFFFFFFULL;
+
+            static uint64_t Add(const uint64_t a, const uint64_t b) {
+                uint64_t s = a + b;
+                return (s >= PRIME ? s - PRIME : s);
+            }
+            static uint64_t Subtract(const uint64_t a, const uint64_t b) {
+                return (a >= b ? a - b : a + PRIME - b);
+            }
+            static uint64_t Negate(const uint64_t a) {
+                return (a == 0 ? 0 : PRIME - a);
+            }
+            static uint64_t Multiply(const uint64_t a, const uint64_t b) {
+                unsigned __int128 p = (unsigned __int128)a * b;
+                uint64_t lo = (uint64_t)(p & PRIME), hi = (uint64_t)(p >> 61);
+                return Add(lo, hi);
+            }
+            static uint64_t FromInteger(const long long);
+            static uint64_t Inverse(const uint64_t);
+
+            static uint64_t RandomSeed();
+            static uint64_t SymbolValue(const std::string&, const uint64_t);
+    };
+}
+
+#endif/*_SYMACHIN_FINITE_FIELD_H*/
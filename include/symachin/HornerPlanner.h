@@ -0,0 +1,66 @@
+#ifndef _SYMACHIN_HORNER_PLANNER_H
+#define _SYMACHIN_HORNER_PLANNER_H
+
+#include <cstddef>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace symachin {
+    /**
+     * Single operation of an evaluation program.
+     * 'dest', 'a', 'b' and 'c' are register indices,
+     * except for LOAD, where 'a' is a symbol slot.
+     */
+    struct eval_op {
+        enum eval_op_type {
+            LOAD,           // dest = x[a]
+            CONST,          // dest = value
+            ADD,            // dest = a + b
+            MUL,            // dest = a * b
+            MULADD,         // dest = a * b + c
+            SCALE           // dest = value * a
+        } type;
+        unsigned int dest, a, b, c;
+        double value;
+    };
+
+    // Monomial as a list of (slot, power), sorted by slot
+    typedef std::vector<std::pair<unsigned int, unsigned int>> monomial;
+
+    class HornerPlanner {
+        private:
+            struct plan_node {
+                eval_op::eval_op_type type;
+                unsigned int a, b, c;
+                double value;
+
+                bool operator==(const plan_node&) const;
+            };
+            struct plan_node_hash {
+                size_t operator()(const plan_node&) const;
+            };
+
+            std::vector<plan_node> nodes;
+            std::unordered_map<plan_node, unsigned int, plan_node_hash> nodeIndex;
+
+            const std::vector<double> *coefficients;
+            const std::vector<monomial> *monomials;
+            std::vector<unsigned int> divisor, count;
+
+            unsigned int exponent(const unsigned int, const unsigned int) const;
+            unsigned int horner(std::vector<unsigned int>&);
+            unsigned int make_node(eval_op::eval_op_type, unsigned int a=0, unsigned int b=0, unsigned int c=0, double value=0.0);
+            unsigned int monomial_node(const unsigned int);
+            unsigned int power(const unsigned int, const unsigned int);
+            unsigned int sum(std::vector<unsigned int>&);
+        public:
+            static const unsigned int NONE = (unsigned int)-1;
+
+            HornerPlanner(const unsigned int);
+
+            unsigned int Plan(const std::vector<double>&, const std::vector<monomial>&, std::vector<eval_op>&, unsigned int*);
+    };
+}
+
+#endif/*_SYMACHIN_HORNER_PLANNER_H*/
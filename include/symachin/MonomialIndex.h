@@ -0,0 +1,46 @@
+#ifndef _SYMACHIN_MONOMIAL_INDEX_H
+#define _SYMACHIN_MONOMIAL_INDEX_H
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+#include "symachin/PackedMonomial.h"
+#include "symachin/Term.h"
+
+namespace symachin {
+    /**
+     * Numbers the monomials (the non-numeric parts) of
+     * terms, in the order they are first inserted, so that
+     * two terms get the same number if, and only if, they
+     * are proportional. Terms are looked up by their packed
+     * monomial (see 'PackedMonomial'), or by the sorted
+     * indices of their symbols (see 'Factor::GetIndex()')
+     * when they cannot be packed. Whether a term can be
+     * packed only depends on its symbols, so proportional
+     * terms always have keys in the same table.
+     */
+    class MonomialIndex {
+        private:
+            struct monomial_hash {
+                size_t operator()(const PackedMonomial&) const;
+            };
+            struct indices_hash {
+                size_t operator()(const std::vector<unsigned int>&) const;
+            };
+
+            std::unordered_map<PackedMonomial, size_t, monomial_hash> packed;
+            std::unordered_map<std::vector<unsigned int>, size_t, indices_hash> unpacked;
+            std::vector<unsigned int> keybuffer;
+
+            const std::vector<unsigned int>& key(const Term&);
+            template <class Table>
+            size_t insert(Table&, const typename Table::key_type&);
+        public:
+            size_t Insert(const Term&);
+            void Insert(const MonomialIndex&, std::vector<size_t>&);
+            size_t Size() const { return packed.size() + unpacked.size(); }
+            void Clear();
+    };
+}
+
+#endif/*_SYMACHIN_MONOMIAL_INDEX_H*/
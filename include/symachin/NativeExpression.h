@@ -0,0 +1,60 @@
+#ifndef _SYMACHIN_NATIVE_EXPRESSION_H
+#define _SYMACHIN_NATIVE_EXPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "symachin/Expression.h"
+
+namespace symachin {
+    class NativeExpression;
+    typedef std::shared_ptr<NativeExpression> NativeExpressionPtr;
+
+    class NativeExpression {
+        private:
+            typedef double (*evaluate_func)(const double*);
+            typedef void (*evaluate_batch_func)(const double *const*, unsigned long, double*);
+
+            // Symbol table (sorted by name)
+            std::vector<std::string> symbols;
+            std::unordered_map<std::string, unsigned int> slots;
+
+            uint64_t fingerprint;
+            std::string library;
+            bool cached = false;
+
+            void *handle = nullptr;
+            evaluate_func func = nullptr;
+            evaluate_batch_func batch = nullptr;
+
+            void compile(const Expression&, const std::string&) const;
+            void compile_private(const Expression&, const std::string&);
+            std::string generate(const Expression&) const;
+            bool load();
+            void unload();
+        public:
+            NativeExpression(const Expression&, const std::string& cachedir="");
+            ~NativeExpression();
+
+            std::vector<double> Bind(const std::map<std::string, double>&, const double other=1.0) const;
+            double Evaluate(const double *values) const { return func(values); }
+            double Evaluate(const std::vector<double>& v) const { return func(v.data()); }
+            double Evaluate(const std::map<std::string, double>&, const double other=1.0) const;
+            void Evaluate(const double *const*, const size_t, double*, unsigned int nthreads=0) const;
+
+            const std::string& GetLibrary() const { return library; }
+            const std::vector<std::string>& GetSymbols() const { return symbols; }
+            unsigned int NumberOfSymbols() const { return symbols.size(); }
+            bool WasCached() const { return cached; }
+
+            static std::string GetCompiler();
+            static std::string GetDefaultCacheDirectory();
+            static bool IsAvailable();
+    };
+}
+
+#endif/*_SYMACHIN_NATIVE_EXPRESSION_H*/
@@ -27,6 +27,7 @@ namespace symachin {
             void CreateRule(const Factor&, const vectorTermPtr);
             void CreateRule(const std::string&, const std::string&);
             virtual ExpressionPtr Operate(const Expression&) const;
+            void OperateInPlace(Expression&) const;
     };
 }
 
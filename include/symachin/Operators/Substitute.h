@@ -0,0 +1,32 @@
+#ifndef _SYMACHIN_SUBSTITUTE_H
+#define _SYMACHIN_SUBSTITUTE_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include "symachin/Expression.h"
+#include "symachin/Operators/Operator.h"
+
+namespace symachin {
+    class Substitute;
+    typedef std::shared_ptr<Substitute> SubstitutePtr;
+
+    class Substitute : public Operator {
+        private:
+            // Value of each symbol, as (numerator, denominator)
+            std::map<std::string, std::pair<long long, long long>> values;
+        public:
+            Substitute();
+            ~Substitute();
+
+            const std::map<std::string, std::pair<long long, long long>>& GetValues() const { return values; }
+
+            void SetValue(const std::string&, const long long, const long long denominator=1);
+            void SetValue(const std::string&, const std::string&);
+            virtual ExpressionPtr Operate(const Expression&) const;
+            ExpressionPtr Operate(const Expression&, long long*) const;
+    };
+}
+
+#endif/*_SYMACHIN_SUBSTITUTE_H*/
@@ -0,0 +1,105 @@
+#ifndef _SYMACHIN_PACKED_MONOMIAL_H
+#define _SYMACHIN_PACKED_MONOMIAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "symachin/Term.h"
+
+namespace symachin {
+    /**
+     * Monomial (the non-numeric part of a term) packed into
+     * two 64-bit words of 4-bit exponent fields, one field
+     * for each of 'MAX_SYMBOLS' (32) symbols. The top bit of
+     * every field is a guard bit, which is clear in a valid
+     * monomial, so that multiplying two monomials is a word
+     * addition, and two monomials are proportional if, and
+     * only if, their words are equal.
+     *
+     * By default, the field of a symbol is given by its
+     * index (see 'Factor::GetIndex()'), so only the first 32
+     * symbols interned in the process can be packed, and
+     * which symbols those are depends on the order in which
+     * expressions were first read. Monomials packed this way
+     * are comparable across all expressions. Alternatively,
+     * the symbols of a set of terms can be numbered afresh
+     * (see 'Slots()'), giving monomials which are only
+     * comparable with those packed with the same numbering.
+     *
+     * Terms involving symbols without a field, or exponents
+     * larger than 'MAX_EXPONENT' (7), cannot be packed and
+     * give an invalid monomial (all guard bits set), which
+     * is never equal to a valid one. Such terms must be
+     * handled with the general operations of 'Term'.
+     */
+    class PackedMonomial {
+        public:
+            static const unsigned int WORDS = 2;
+            static const unsigned int FIELD_BITS = 4;
+            static const unsigned int FIELDS_PER_WORD = 64 / FIELD_BITS;
+            static const unsigned int MAX_SYMBOLS = WORDS * FIELDS_PER_WORD;
+            static const unsigned int MAX_EXPONENT = 7;
+            static const uint64_t FIELD_MASK = 0xFULL;
+            static const uint64_t GUARD = 0x8888888888888888ULL;
+        private:
+            uint64_t words[WORDS];
+
+            void pack(const Term&, const std::vector<unsigned int>*);
+        public:
+            PackedMonomial() { words[0] = words[1] = 0; }
+            PackedMonomial(const Term&);
+            PackedMonomial(const Term&, const std::vector<unsigned int>&);
+
+            bool IsValid() const { return ((words[0] | words[1]) & GUARD) == 0; }
+            unsigned int Degree() const;
+            size_t Hash() const;
+
+            /**
+             * Returns the exponent of the symbol with the
+             * given index (less than 'MAX_SYMBOLS').
+             */
+            unsigned int Exponent(const unsigned int i) const {
+                return (unsigned int)((words[i / FIELDS_PER_WORD] >> ((i % FIELDS_PER_WORD) * FIELD_BITS)) & FIELD_MASK);
+            }
+
+            /**
+             * Check if this monomial divides the given monomial,
+             * i.e. if no exponent of this monomial is larger than
+             * the corresponding exponent of 'm'. Both monomials
+             * must be valid.
+             */
+            bool Divides(const PackedMonomial &m) const {
+                return (((m.words[0] | GUARD) - words[0]) & GUARD) == GUARD &&
+                       (((m.words[1] | GUARD) - words[1]) & GUARD) == GUARD;
+            }
+
+            /**
+             * Multiply two monomials. The product is invalid if
+             * either monomial is, or if an exponent overflows.
+             */
+            PackedMonomial operator*(const PackedMonomial &m) const {
+                PackedMonomial p;
+                if (!IsValid() || !m.IsValid())
+                    return Invalid();
+
+                p.words[0] = words[0] + m.words[0];
+                p.words[1] = words[1] + m.words[1];
+                return (p.IsValid() ? p : Invalid());
+            }
+
+            bool operator==(const PackedMonomial &m) const {
+                return words[0] == m.words[0] && words[1] == m.words[1];
+            }
+            bool operator!=(const PackedMonomial &m) const { return !(*this == m); }
+
+            static std::vector<unsigned int> Slots(const std::vector<TermPtr>&, const std::vector<TermPtr>&);
+
+            static PackedMonomial Invalid() {
+                PackedMonomial m;
+                m.words[0] = m.words[1] = GUARD;
+                return m;
+            }
+    };
+}
+
+#endif/*_SYMACHIN_PACKED_MONOMIAL_H*/
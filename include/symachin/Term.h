@@ -1,6 +1,7 @@
 #ifndef _SYMACHIN_TERM_H
 #define _SYMACHIN_TERM_H
 
+#include <cstdint>
 #include <map>
 #include <memory>
 #include <vector>
@@ -24,20 +25,24 @@ namespace symachin {
             bool ContainsTerm(const Term&) const;
             vectorFactorPtr GetFactors() const { return factors; }
             vectorFactorPtr GetNonNumericFactors() const;
-            int GetNumericFactorValue(bool withsign=true) const;
+            long long GetNumericFactorValue(bool withsign=true) const;
             enum sign GetSign() const;
             bool HasFactor(const Factor&) const;
             bool HasNumericFactor() const;
             bool IsZero() const;
+            unsigned int Degree() const;
 
             double Evaluate(const std::map<std::string, double>&, const double other=1.0) const;
+            uint64_t EvaluateModular(const uint64_t) const;
 
             void Multiply(const Factor&);
+            void Multiply(const FactorPtr&);
             void Multiply(const Term&);
 
             void RemoveFactor(const Factor&);
             void RemoveTerm(const Term&);
             void ReplaceFactors(vectorFactorPtr);
+            void SetNumericFactorValue(const long long);
 
             void Negate();
             int NumberOfFactors() const;
@@ -51,6 +56,8 @@ namespace symachin {
             std::string ToStringFormatted() const;
 
             bool operator==(const Term &t) const { return IsEqual(t); }
+
+            static void Unshare(TermPtr&);
     };
 }
 
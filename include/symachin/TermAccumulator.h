@@ -0,0 +1,51 @@
+#ifndef _SYMACHIN_TERM_ACCUMULATOR_H
+#define _SYMACHIN_TERM_ACCUMULATOR_H
+
+#include <cstddef>
+#include <exception>
+#include <vector>
+#include "symachin/MonomialIndex.h"
+#include "symachin/Term.h"
+
+namespace symachin {
+    class TermAccumulator {
+        private:
+            static const size_t NONE = (size_t)-1;
+
+            // A run of terms summed on its own (see 'Sum()').
+            // For each monomial of the run: the sum of its
+            // coefficients, the smallest and largest partial
+            // sums before each of its terms, and the position
+            // of its last term and of the last term preceded
+            // by a zero partial sum. 'failed' is set if the
+            // runs must be summed serially instead
+            struct run_sum {
+                MonomialIndex index;
+                std::vector<size_t> numbers;
+                std::vector<long long> total, low, high;
+                std::vector<size_t> birth, last;
+                bool failed=false;
+                std::exception_ptr error;
+            };
+
+            std::vector<TermPtr> terms;
+            std::vector<long long> coefficients;
+            std::vector<bool> merged;
+
+            // Position in 'terms' of each monomial in the
+            // sum (by its number in 'index'), or 'NONE'
+            MonomialIndex index;
+            std::vector<size_t> positions;
+            size_t size=0;
+
+            static void sum_run(const std::vector<TermPtr>&, run_sum&);
+        public:
+            void Add(TermPtr);
+            bool IsEmpty() const { return size == 0; }
+            vectorTermPtr Terms();
+
+            static vectorTermPtr Sum(std::vector<std::vector<TermPtr>>&);
+    };
+}
+
+#endif/*_SYMACHIN_TERM_ACCUMULATOR_H*/
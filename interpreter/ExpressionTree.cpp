@@ -0,0 +1,328 @@
+/**
+ * Implementation of the 'ExpressionTree' class.
+ *
+ * An expression tree is built by the parser for every
+ * expression in a statement. References to labels are
+ * resolved to the stored expressions when the tree is
+ * evaluated, so that for example '[B]: $A;' shares the
+ * expression of 'A' instead of printing and re-parsing it.
+ * Stored expressions are never modified: an operand which
+ * is shared is copied before arithmetic is done on it.
+ *
+ * A sum is evaluated by adding the terms of all of its
+ * operands to a single 'TermAccumulator', so that its
+ * evaluation takes time linear in the number of terms.
+ *
+ * Parts of a tree which do not refer to any label can be
+ * folded into constants, which are evaluated only once.
+ * Such a part is written back to text and read with the
+ * 'ExpressionParser' of the library, which reads a literal
+ * expression in linear time (and in parallel when it is
+ * very long).
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "symachin/Expression.h"
+#include "symachin/ExpressionParser.h"
+#include "symachin/SymachinException.h"
+#include "symachin/TermAccumulator.h"
+#include "interpreter/ExpressionTree.h"
+
+using namespace std;
+using namespace symachin;
+
+/**
+ * Constructor. Create a leaf.
+ *
+ * type: Type of leaf ('SYMBOL' or 'REFERENCE').
+ * text: Name of the symbol (or numeric value), or
+ *       label referred to.
+ */
+ExpressionTree::ExpressionTree(node_type type, const string &text) {
+    this->type = type;
+    this->text = text;
+}
+
+/**
+ * Constructor. Create a constant leaf.
+ *
+ * expr: Value of the leaf.
+ */
+ExpressionTree::ExpressionTree(const ExpressionPtr &expr) {
+    this->type = CONSTANT;
+    this->expr = expr;
+}
+
+/**
+ * Constructor. Create an operator node.
+ *
+ * type:     Type of operator ('SUM' or 'PRODUCT').
+ * operands: Operands, in order.
+ * negated:  For a sum, whether each of the operands
+ *           is subtracted rather than added.
+ */
+ExpressionTree::ExpressionTree(node_type type, const vector<ExpressionTreePtr> &operands, const vector<bool> &negated) {
+    this->type = type;
+    this->operands = operands;
+    this->negated = negated;
+
+    if (type == SUM)
+        this->negated.resize(operands.size(), false);
+}
+
+/**
+ * Evaluate this tree to an expression. If the tree is a
+ * single reference, the referenced expression itself is
+ * returned.
+ *
+ * labels: Stored expressions of labels.
+ */
+ExpressionPtr ExpressionTree::Evaluate(const LabelMap &labels) const {
+    bool shared;
+    return evaluate(labels, shared);
+}
+
+/**
+ * Evaluate this tree to an expression.
+ *
+ * labels: Stored expressions of labels.
+ * shared: Set to 'true' if the returned expression is
+ *         a stored expression which must not be modified.
+ */
+ExpressionPtr ExpressionTree::evaluate(const LabelMap &labels, bool &shared) const {
+    ExpressionPtr l, r;
+    bool lshared, rshared;
+
+    switch (type) {
+        case SYMBOL: {
+            Term t(text);
+            shared = false;
+            return ExpressionPtr(new Expression(t));
+        }
+
+        case CONSTANT:
+            shared = true;
+            return expr;
+
+        case REFERENCE: {
+            LabelMap::const_iterator it = labels.find(text);
+            if (it == labels.end())
+                throw SymachinException("Label '%s' has not been defined.", text.c_str());
+
+            shared = true;
+            return it->second;
+        }
+
+        case PRODUCT:
+            l = operands.front()->evaluate(labels, lshared);
+            for (vector<ExpressionTreePtr>::const_iterator it = operands.begin()+1; it != operands.end(); it++) {
+                r = (*it)->evaluate(labels, rshared);
+                l = Expression::Multiply(*l, *r);
+            }
+
+            shared = (operands.size() == 1 && lshared);
+            return l;
+
+        case SUM:
+            // A sign applied to a single operand
+            if (operands.size() == 1) {
+                l = operands.front()->evaluate(labels, lshared);
+                if (!negated.front()) {
+                    shared = lshared;
+                    return l;
+                }
+
+                if (lshared)
+                    l = ExpressionPtr(new Expression(*l));
+
+                l->Negate();
+                shared = false;
+                return l;
+            }
+
+            return sum(labels, shared);
+    }
+
+    shared = false;
+    return nullptr;
+}
+
+/**
+ * Evaluate this tree, which is a sum, by adding the terms
+ * of all operands to a single accumulator (which gives the
+ * same result as adding the operands one by one).
+ *
+ * labels: Stored expressions of labels.
+ * shared: Set to 'false' (the sum is a new expression).
+ */
+ExpressionPtr ExpressionTree::sum(const LabelMap &labels, bool &shared) const {
+    TermAccumulator acc;
+    bool oshared;
+
+    for (size_t i = 0; i < operands.size(); i++) {
+        ExpressionPtr op = operands[i]->evaluate(labels, oshared);
+        vectorTermPtr terms = op->GetTerms();
+
+        for (vector<TermPtr>::const_iterator it = terms->begin(); it != terms->end(); it++) {
+            if ((*it)->IsZero())
+                continue;
+
+            if (negated[i]) {
+                TermPtr t(new Term(*(*it)));
+                t->Negate();
+                acc.Add(t);
+            } else
+                acc.Add(*it);
+        }
+    }
+
+    shared = false;
+    return ExpressionPtr(new Expression(acc.Terms()));
+}
+
+/**
+ * Append the labels referred to in this tree to
+ * the given list.
+ *
+ * refs: List of labels to append to.
+ */
+void ExpressionTree::GetReferences(vector<string> &refs) const {
+    if (type == REFERENCE)
+        refs.push_back(text);
+
+    for (vector<ExpressionTreePtr>::const_iterator it = operands.begin(); it != operands.end(); it++)
+        (*it)->GetReferences(refs);
+}
+
+/**
+ * Append the text of this tree (which must not refer to
+ * any label) to the given string, in the syntax read by
+ * 'ExpressionParser'. Returns 'false' if the tree cannot be
+ * written that way, i.e. if it contains a constant, or a
+ * symbol with characters that are special to the parser.
+ *
+ * out: String to append to.
+ */
+bool ExpressionTree::write_text(string &out) const {
+    switch (type) {
+        case SYMBOL:
+            if (text.find_first_of(" \t\n\r+-*()[]{}") != string::npos)
+                return false;
+
+            out += text;
+            return true;
+
+        case PRODUCT:
+        case SUM:
+            for (size_t i = 0; i < operands.size(); i++) {
+                if (type == SUM && negated[i])
+                    out += '-';
+                else if (i > 0)
+                    out += (type == SUM ? '+' : '*');
+
+                // Only a sum needs parentheses as an operand
+                if (operands[i]->type == SUM) {
+                    out += '(';
+                    if (!operands[i]->write_text(out))
+                        return false;
+                    out += ')';
+                } else if (!operands[i]->write_text(out))
+                    return false;
+            }
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+/**
+ * Fold all maximal subtrees of the given tree which do
+ * not refer to any label into constants. Subtrees which
+ * cannot be evaluated (e.g. because of an overflow) are
+ * kept as is, so that the error is reported when the
+ * statement is executed.
+ *
+ * tree:     Tree to fold.
+ * nthreads: Number of threads to use when parsing long
+ *           literal expressions (0 = one per core).
+ */
+ExpressionTreePtr ExpressionTree::Fold(const ExpressionTreePtr &tree, const unsigned int nthreads) {
+    bool refs;
+    ExpressionTreePtr t = fold(tree, refs, nthreads);
+
+    return (refs ? t : constant(t, nthreads));
+}
+
+/**
+ * Returns a constant leaf with the value of the given
+ * tree, which must not refer to any label. Leaves, and
+ * trees which cannot be evaluated, are returned as is.
+ *
+ * tree:     Tree to evaluate.
+ * nthreads: Number of threads to use when parsing
+ *           (0 = one per core).
+ */
+ExpressionTreePtr ExpressionTree::constant(const ExpressionTreePtr &tree, const unsigned int nthreads) {
+    string text;
+
+    if (tree->type == CONSTANT || tree->type == SYMBOL)
+        return tree;
+
+    try {
+        if (!tree->write_text(text))
+            return ExpressionTreePtr(new ExpressionTree(tree->Evaluate(LabelMap())));
+
+        ExpressionParser p(nthreads);
+        return ExpressionTreePtr(new ExpressionTree(p.Parse(text)));
+    } catch (SymachinException &ex) {
+        return tree;
+    }
+}
+
+/**
+ * Fold the subtrees of the given tree which refer to a
+ * label (see 'Fold()'). Trees which do not refer to any
+ * label are returned unchanged, to be folded as a whole
+ * by the caller.
+ *
+ * tree:     Tree to fold.
+ * refs:     Set to 'true' if the tree refers to a label.
+ * nthreads: Number of threads to use when parsing.
+ */
+ExpressionTreePtr ExpressionTree::fold(const ExpressionTreePtr &tree, bool &refs, const unsigned int nthreads) {
+    vector<ExpressionTreePtr> ops;
+    vector<bool> orefs;
+
+    switch (tree->type) {
+        case CONSTANT:
+        case SYMBOL:
+            refs = false;
+            return tree;
+        case REFERENCE:
+            refs = true;
+            return tree;
+        default: break;
+    }
+
+    refs = false;
+    for (vector<ExpressionTreePtr>::const_iterator it = tree->operands.begin(); it != tree->operands.end(); it++) {
+        bool r = false;
+        ops.push_back(fold(*it, r, nthreads));
+        orefs.push_back(r);
+        refs = (refs || r);
+    }
+
+    if (!refs)
+        return tree;
+
+    // Fold the operands which do not refer to labels
+    for (size_t i = 0; i < ops.size(); i++) {
+        if (!orefs[i])
+            ops[i] = constant(ops[i], nthreads);
+    }
+
+    return ExpressionTreePtr(new ExpressionTree(tree->type, ops, tree->negated));
+}
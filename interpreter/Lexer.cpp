@@ -1,23 +1,42 @@
 /**
  * Implementation of the 'Lexer' class.
+ *
+ * Source files are memory-mapped rather than read into
+ * memory, and the text of each token refers directly to
+ * the mapped bytes. Tokens are produced one at a time as
+ * the parser asks for them.
  */
 
 #include <fstream>
 #include <sstream>
 #include <string>
 #include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "interpreter/Lexer.h"
 #include "interpreter/LexerException.h"
 
 using namespace std;
 
+/**
+ * Destructor. Unmaps all source files.
+ */
+Lexer::~Lexer() {
+    for (vector<pair<void*, size_t>>::iterator it = mappings.begin(); it != mappings.end(); it++)
+        munmap(it->first, it->second);
+    for (vector<string*>::iterator it = strings.begin(); it != strings.end(); it++)
+        delete *it;
+}
+
 /**
  * Get the next character from the buffer.
  */
 char Lexer::gchar() {
     char c;
     if (bufcount >= buflen)
-        return 0;
+        return (current = 0);
 
     c = buffer[bufcount++];
 
@@ -57,13 +76,14 @@ char Lexer::gchar() {
                     charpos++;
                 }
 
-                return gchar();
+                // Comments separate tokens
+                c = ' ';
             }
         default: break;
     }
 
     charpos++;
-    return c;
+    return (current = c);
 }
 
 /**
@@ -72,17 +92,8 @@ char Lexer::gchar() {
 char Lexer::cchar() {
     if (bufcount == 0)
         return gchar();
-    else {
-        char c = buffer[bufcount-1];
-        switch (c) {
-            case '\n':
-            case '\t':
-            case '\r':
-                return ' ';
-            default:
-                return c;
-        }
-    }
+    else
+        return current;
 }
 
 /**
@@ -115,115 +126,158 @@ ttype Lexer::is_operator(const char c) const {
 }
 
 /**
- * Return the next token from the buffer.
+ * Read the next token from the current buffer.
+ * Returns 'false' if the end of the buffer has been
+ * reached.
+ *
+ * tkn: Token to store result in.
  */
-token *Lexer::next() {
+bool Lexer::next(token &tkn) {
     char c = cchar();
-    token *tkn = new token;
-
-    tkn->filename = filename;
-    tkn->charpos = charpos;
-    tkn->line = line;
-
-    // An 'accidental' null-character may occur
-    // if we've switched back to the original buffer
-    // after including a file. If so, reread the
-    // buffer. If we've truly reached the end of
-    // this buffer, we will get another null char.
-    /*if (c == 0) {
-        c = gchar();
-        if (c == 0) {
-            tkn->type = token::ENDOFSTREAM;
-            tkn->text.clear();
-            return tkn;
-        }
-    }*/
+
+    tkn.text = lex_text();
+    tkn.filename = filename;
+    tkn.charpos = charpos;
+    tkn.line = line;
+    tkn.type = token::UNKNOWN;
+
+    if (c == 0)     // End-of-stream
+        return false;
 
     do {
         if (c == ' ') {
-            if (tkn->text.length() > 0)
+            if (!tkn.text.empty())
                 break;
             else continue;
         } else if (c == '"') {  // Beginning of string
-            if (tkn->text.length() > 0)
+            if (!tkn.text.empty())
                 break;
-            
-            while (bufcount < buflen && buffer[bufcount] != '"') {
-                tkn->text += buffer[bufcount++];
-            }
+
+            long start = bufcount;
+            while (bufcount < buflen && buffer[bufcount] != '"')
+                bufcount++;
+
+            tkn.text = lex_text(buffer+start, bufcount-start);
 
             // Skip '"'
             bufcount++;
             gchar();
 
-            if (tkn->text.length() > 0) {
-                tkn->type = token::WORD;
-                return tkn;
+            if (!tkn.text.empty()) {
+                tkn.type = token::WORD;
+                return true;
             }
-        } else if ((tkn->type=is_operator(c))!=token::UNKNOWN) {
-            if (tkn->text.length() > 0)
+        } else if ((tkn.type=is_operator(c))!=token::UNKNOWN) {
+            if (!tkn.text.empty())
                 break;
-            else if (tkn->type == token::MINUS && peek()=='>') {
+
+            tkn.text = lex_text(buffer+bufcount-1, 1);
+            if (tkn.type == token::MINUS && peek()=='>') {
                 gchar();
-                tkn->type = token::RARROW;
-                tkn->text = "->";
-            } else tkn->text = c;
+                tkn.type = token::RARROW;
+                tkn.text.length = 2;
+            }
 
             c = gchar();
-            return tkn;
-        } else
-            tkn->text += c;
+            return true;
+        } else if (tkn.text.empty())
+            tkn.text = lex_text(buffer+bufcount-1, 1);
+        else
+            tkn.text.length++;
     } while ((c=gchar())!=0);
 
-    if (tkn->text.empty()) {    // End-of-stream
-        delete tkn;
-        return nullptr;
+    if (tkn.text.empty())       // End-of-stream
+        return false;
+
+    lex_text &t = tkn.text;
+    if (t.data[0] == '$') {
+        tkn.type = token::REFERENCE;
+        t = lex_text(t.data+1, t.length-1);
+    } else if (t.data[0] == '[' && t.data[t.length-1] == ']') {
+        if (t.length <= 2)
+            Error("Label is empty.");
+        tkn.type = token::LABEL;
+        t = lex_text(t.data+1, t.length-2);
+    } else if (t == "apply") {
+        tkn.type = token::APPLY;
+    } else if (t == "assert") {
+        tkn.type = token::ASSERT;
+    } else if (t == "by") {
+        tkn.type = token::BY;
+    } else if (t == "define") {
+        tkn.type = token::DEFINE;
+    } else if (t == "end") {
+        tkn.type = token::END;
+    } else if (t == "eval") {
+        tkn.type = token::EVAL;
+    } else if (t == "export") {
+        tkn.type = token::EXPORT;
+    } else if (t == "free") {
+        tkn.type = token::FREE;
+    } else if (t == "group") {
+        tkn.type = token::GROUP;
+    } else if (t == "in") {
+        tkn.type = token::IN;
+    } else if (t == "include") {
+        tkn.type = token::INCLUDE;
+    } else if (t == "other") {
+        tkn.type =token::OTHER;
+    } else if (t == "print") {
+        tkn.type = token::PRINT;
+    } else if (t == "printf") {
+        tkn.type = token::PRINTF;
+    } else if (t == "printn") {
+        tkn.type = token::PRINTN;
+    } else if (t == "replace") {
+        tkn.type = token::REPLACE;
+    } else if (t == "substitute") {
+        tkn.type = token::SUBSTITUTE;
+    } else if (t == "to") {
+        tkn.type = token::TO;
+    } else if (t == "with") {
+        tkn.type = token::WITH;
+    } else if (t == "wrt") {
+        tkn.type = token::WRT;
     } else {
-        if (tkn->text[0] == '$') {
-            tkn->type = token::REFERENCE;
-            tkn->text.erase(0,1);
-        } else if (tkn->text.front() == '[' && tkn->text.back() == ']') {
-            if (tkn->text.length() == 2)
-                Error("Label is empty.");
-            tkn->type = token::LABEL;
-            tkn->text = tkn->text.substr(1, tkn->text.length()-2);
-        } else if (tkn->text == "apply") {
-            tkn->type = token::APPLY;
-        } else if (tkn->text == "assert") {
-            tkn->type = token::ASSERT;
-        } else if (tkn->text == "by") {
-            tkn->type = token::BY;
-        } else if (tkn->text == "define") {
-            tkn->type = token::DEFINE;
-        } else if (tkn->text == "end") {
-            tkn->type = token::END;
-        } else if (tkn->text == "eval") {
-            tkn->type = token::EVAL;
-        } else if (tkn->text == "group") {
-            tkn->type = token::GROUP;
-        } else if (tkn->text == "in") {
-            tkn->type = token::IN;
-        } else if (tkn->text == "include") {
-            tkn->type = token::INCLUDE;
-        } else if (tkn->text == "other") {
-            tkn->type =token::OTHER;
-        } else if (tkn->text == "print") {
-            tkn->type = token::PRINT;
-        } else if (tkn->text == "printf") {
-            tkn->type = token::PRINTF;
-        } else if (tkn->text == "printn") {
-            tkn->type = token::PRINTN;
-        } else if (tkn->text == "replace") {
-            tkn->type = token::REPLACE;
-        } else if (tkn->text == "to") {
-            tkn->type = token::TO;
-        } else if (tkn->text == "with") {
-            tkn->type = token::WITH;
-        } else {
-            tkn->type = token::WORD;
-        }
+        tkn.type = token::WORD;
+    }
+
+    return true;
+}
 
-        return tkn;
+/**
+ * Return the next token of the input. Included
+ * files are opened as their 'include' statements are
+ * reached. Returns 'false' at the end of the input.
+ *
+ * tkn: Token to store result in.
+ */
+bool Lexer::Next(token &tkn) {
+    for (;;) {
+        if (next(tkn)) {
+            if (tkn.type != token::INCLUDE)
+                return true;
+
+            if (!next(tkn) || tkn.type != token::WORD)
+                Error("Expected name of file after INCLUDE.");
+
+            LoadFile(tkn.text);
+        } else if (includes.empty())
+            return false;
+        else {
+            // Return to the including file
+            const lex_state &s = includes.back();
+
+            buffer = s.buffer;
+            bufcount = s.bufcount;
+            buflen = s.buflen;
+            filename = s.filename;
+            charpos = s.charpos;
+            line = s.line;
+            current = s.current;
+
+            includes.pop_back();
+        }
     }
 }
 
@@ -231,82 +285,92 @@ token *Lexer::next() {
  * Throw a LexerException.
  */
 void Lexer::Error(const string &msg) {
-    throw LexerException("%s: line %d:%d: %s", filename.c_str(), line, charpos, msg.c_str());
+    throw LexerException("%s: line %d:%d: %s", (filename == nullptr ? "" : filename->c_str()), line, charpos, msg.c_str());
 }
 
 /**
- * Include the file with the given name.
+ * Start reading from the given buffer. If another
+ * buffer is being read, reading continues with that
+ * buffer once the end of the new buffer is reached.
+ *
+ * data:  Buffer to read.
+ * len:   Length of buffer.
+ * fname: Name of file associated with the buffer.
  */
-vector<token*> *Lexer::IncludeFile(const string &fname, vector<token*> *tokens) {
-    string
-        _buffer = buffer,
-        _filename = filename;
-    long
-        _buflen = buflen,
-        _bufcount = bufcount,
-        _line = line,
-        _charpos = charpos;
-
-    tokens = LexFile(fname, tokens);
-
-    charpos = _charpos;
-    line = _line;
-    bufcount = _bufcount;
-    buflen = _buflen;
-    filename = _filename;
-    buffer = _buffer;
-
-    return tokens;
+void Lexer::push(const char *data, size_t len, const string &fname) {
+    if (filename != nullptr) {
+        lex_state s = { buffer, bufcount, buflen, filename, charpos, line, current };
+        includes.push_back(s);
+    }
+
+    buffer = data;
+    buflen = len;
+    bufcount = 0;
+    line = 1;
+    charpos = 1;
+    current = 0;
+
+    filename = &(*filenames.insert(fname).first);
 }
 
 /**
- * Conduct lexical analysis on the contents of
- * the file with the given name.
+ * Prepare to conduct lexical analysis on the
+ * contents of the file with the given name. Regular
+ * files are memory-mapped.
  */
-vector<token*> *Lexer::LexFile(const string &filename, vector<token*> *tokens) {
-    ifstream cfile(filename);
+void Lexer::LoadFile(const string &fname) {
+    struct stat st;
+    int fd = open(fname.c_str(), O_RDONLY);
+
+    if (fd < 0)
+        throw LexerException("Unable to open file: %s.", fname.c_str());
+
+    files.push_back(fname);
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        size_t len = st.st_size;
+        void *addr = nullptr;
+
+        if (len > 0)
+            addr = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (addr != MAP_FAILED) {
+            close(fd);
+
+            if (addr != nullptr) {
+                madvise(addr, len, MADV_SEQUENTIAL);
+                mappings.push_back(make_pair(addr, len));
+            }
+
+            push((const char*)addr, len, fname);
+            return;
+        }
+    }
+
+    close(fd);
+
+    // Not a regular file (or could not be mapped)
+    ifstream cfile(fname);
     stringstream bfr;
 
     if (!cfile.is_open())
-        throw LexerException("Unable to open file: %s.", filename.c_str());
-    
+        throw LexerException("Unable to open file: %s.", fname.c_str());
+
     bfr << cfile.rdbuf();
     cfile.close();
 
-    string contents = bfr.str();
-    return Lex(contents, filename, tokens);
+    Load(bfr.str(), fname);
 }
 
 /**
- * Conduct lexical analysis on the given string.
+ * Prepare to conduct lexical analysis on the
+ * given string.
  *
  * contents: Source code to lex.
  * fname:    Name of file associated with the source code.
  */
-vector<token*> *Lexer::Lex(string &contents, const string &fname, vector<token*> *tokens) {
-    buffer = contents;
-    buflen = buffer.length();
-    bufcount = 0;
-    line = 1;
-    charpos = 1;
+void Lexer::Load(const string &contents, const string &fname) {
+    string *s = new string(contents);
+    strings.push_back(s);
 
-    filename = fname;
-
-    token *tkn;
-    if (tokens == nullptr)
-        tokens = new vector<token*>();
-
-    while ((tkn=next())!=nullptr) {
-        if (tkn->type == token::INCLUDE) {
-            tkn = next();
-            if (tkn->type != token::WORD)
-                Error("Expected name of file after INCLUDE.");
-
-            IncludeFile(tkn->text, tokens);
-        } else
-            tokens->push_back(tkn);
-    }
-
-    return tokens;
+    push(s->data(), s->length(), fname);
 }
-
@@ -3,6 +3,7 @@
  */
 
 #include <iostream>
+#include <string>
 #include "symachin/Expression.h"
 #include "symachin/SymachinException.h"
 #include "interpreter/Lexer.h"
@@ -17,32 +18,116 @@ void lexout(const string &fname) {
     Lexer lex;
 
     try {
-        vector<token*> *tokens = lex.LexFile(fname);
-        for (vector<token*>::iterator it = tokens->begin(); it != tokens->end(); it++) {
-            token *tkn = *it;
-            cout << tkn->ToString() << endl;
-        }
+        token tkn;
+        lex.LoadFile(fname);
+        while (lex.Next(tkn))
+            cout << tkn.ToString() << endl;
     } catch (LexerException &ex) {
         cout << "ERROR: " << ex.whats() << endl;
     }
 }
 
-void parse(const string &fname, Parser &p) {
+bool parse(const string &fname, Parser &p) {
     try {
         p.ParseFile(fname);
     } catch (SymachinException &ex) {
         cout << "ERROR: " << ex.whats() << endl;
+        return false;
     }
+
+    return true;
+}
+
+void usage(const char *prog) {
+    cout << "Usage: " << prog << " [options] file ..." << endl
+         << endl
+         << "Options:" << endl
+         << "  --assert-points N   Number of random points at which to compare" << endl
+         << "                      the two sides of an 'assert' with" << endl
+         << "                      --random-assert (default: 2)." << endl
+         << "  --exact-assert      Compare the two sides of an 'assert' exactly" << endl
+         << "                      (the default)." << endl
+         << "  --free-labels       Drop the expression of a label after its last" << endl
+         << "                      use in a script." << endl
+         << "  --jit               Compile expressions to native code with the" << endl
+         << "                      system C compiler for 'eval'." << endl
+         << "  --jit-cache DIR     Directory in which to cache compiled expressions" << endl
+         << "                      (default: $SYMACHIN_CACHE or ~/.cache/symachin)." << endl
+         << "  --lazy              Compute the expressions of labels only when" << endl
+         << "                      they are needed." << endl
+         << "  --modular           Reduce all numbers modulo a large prime and" << endl
+         << "                      report every failing 'assert' without stopping." << endl
+         << "  --parallel          Execute independent statements of a script" << endl
+         << "                      concurrently." << endl
+         << "  --random-assert     Compare the two sides of an 'assert' at random" << endl
+         << "                      points instead of expanding their difference." << endl
+         << "  --script-cache      Cache parsed scripts next to the source files" << endl
+         << "                      (as FILE.smc), and reuse them while the sources" << endl
+         << "                      are unchanged." << endl
+         << "  --threads N         Number of threads to use (default: one per core)." << endl
+         << "  --verbose           Report the probability of error of every" << endl
+         << "                      'assert' passed at random points." << endl;
 }
 
 int main(int argc, char *argv[]) {
     Parser p;
+    bool modular = false, success = true;
 
     int i;
     for (i = 1; i < argc; i++) {
-        string filename(argv[i]);
-        parse(filename, p);
+        string arg(argv[i]);
+
+        if (arg == "--assert-points") {
+            if (++i >= argc) {
+                usage(argv[0]);
+                return 1;
+            }
+            p.SetAssertPoints(stoi(argv[i]));
+        } else if (arg == "--threads") {
+            if (++i >= argc) {
+                usage(argv[0]);
+                return 1;
+            }
+            p.SetThreads(stoi(argv[i]));
+        } else if (arg == "--jit-cache") {
+            if (++i >= argc) {
+                usage(argv[0]);
+                return 1;
+            }
+            p.SetJITCache(argv[i]);
+        } else if (arg == "--exact-assert")
+            p.SetExactAssert(true);
+        else if (arg == "--random-assert")
+            p.SetExactAssert(false);
+        else if (arg == "--free-labels")
+            p.SetFreeLabels(true);
+        else if (arg == "--jit")
+            p.SetJIT(true);
+        else if (arg == "--lazy")
+            p.SetLazy(true);
+        else if (arg == "--parallel")
+            p.SetParallel(true);
+        else if (arg == "--script-cache")
+            p.SetScriptCache(true);
+        else if (arg == "--verbose")
+            p.SetVerbose(true);
+        else if (arg == "--modular") {
+            modular = true;
+            p.SetModular(true);
+        } else if (arg == "-h" || arg == "--help") {
+            usage(argv[0]);
+            return 0;
+        } else
+            success = parse(arg, p) && success;
+    }
+
+    if (modular) {
+        cout << p.GetNumberOfFailedAsserts() << " of " << p.GetNumberOfAsserts()
+             << " assertions failed in modular mode." << endl;
+
+        if (p.GetNumberOfFailedAsserts() > 0)
+            success = false;
     }
 
-    return 0;
+    return (success ? 0 : 1);
 }
@@ -2,38 +2,81 @@
  * Implementation of parser commands.
  */
 
+#include <fstream>
 #include <iostream>
+#include <mutex>
 #include <string>
+#include <unordered_set>
+#include <utility>
 #include <vector>
+#include "symachin/CodeGenerator.h"
+#include "symachin/CompiledExpression.h"
 #include "symachin/Expression.h"
+#include "symachin/ExpressionParserException.h"
+#include "symachin/FactorException.h"
+#include "symachin/NativeExpression.h"
 #include "symachin/Operators/Replace.h"
+#include "symachin/Operators/Substitute.h"
+#include "symachin/SymachinException.h"
 #include "interpreter/Parser.h"
+#include "interpreter/Scheduler.h"
+#include "interpreter/Table.h"
+#include "interpreter/Thunk.h"
 
 using namespace std;
 using namespace symachin;
 
 /**
- * Apply the rule of the given name to the
- * expression of the given name.
+ * Apply the given rule to the given expression. If
+ * nothing else refers to the expression, it is updated
+ * in place.
  *
- * nrule: Name of rule to apply.
- * nexpr: Name of expression to apply rule to.
+ * label: Label to assign the result to.
+ * rule:  Rule to apply.
+ * expr:  Expression to apply rule to.
  */
-void Parser::apply_to(const string &label, const string &nrule, ExpressionPtr &expr) {
-    if (rules.count(nrule) == 0)
-        Error("No rule named '%s' defined.");
+void Parser::apply_to(const string &label, ReplacePtr &rule, ExpressionPtr &expr) {
+    if (expr.use_count() == 1) {
+        rule->OperateInPlace(*expr);
+        assign(label, expr);
+        return;
+    }
 
-    ReplacePtr rule = rules[nrule];
     ExpressionPtr rexpr = rule->Operate(*expr);
     assign(label, rexpr);
 }
 
 /**
  * Assert that the two expressions are equal.
+ * If 'exactAssert' is cleared (with '--random-assert'),
+ * the expressions are compared at 'assertPoints' random
+ * points (see 'Expression::IsEqualRandomized()'). In modular mode,
+ * failed assertions are only reported. In verbose mode,
+ * the probability that a passed randomized assertion is
+ * wrong is reported.
  */
 void Parser::assert(ExpressionPtr &e1, ExpressionPtr &e2) {
-    if (!e1->IsEqual(*e2))
-        Error("Assertion failed. The two expressions are NOT equal.");
+    bool equal;
+    double errprob = 0.0;
+    if (exactAssert)
+        equal = e1->IsEqual(*e2);
+    else
+        equal = e1->IsEqualRandomized(*e2, assertPoints, &errprob);
+
+    {
+        lock_guard<mutex> guard(lock);
+        nAsserts++;
+        if (!equal)
+            nFailedAsserts++;
+    }
+
+    if (!equal) {
+        if (modular)
+            Warning("Assertion failed. The two expressions are NOT equal.");
+        else
+            Error("Assertion failed. The two expressions are NOT equal.");
+    } else if (verbose && !exactAssert)
+        Note("Assertion holds, with a probability of error of at most %g.", errprob);
 }
 
 /**
@@ -43,6 +86,14 @@ void Parser::assert(ExpressionPtr &e1, ExpressionPtr &e2) {
  * expr:  Expression to store.
  */
 void Parser::assign(const string &label, ExpressionPtr &expr) {
+    // Values computed for a thunk are stored in the thunk
+    if (thunkValues != nullptr) {
+        (*thunkValues)[label] = expr;
+        return;
+    }
+
+    lock_guard<mutex> guard(lock);
+
     // If an expression with the same,
     // label exists overwrite it
     if (expressions.count(label) > 0)
@@ -63,7 +114,9 @@ void Parser::assign(const string &label, ExpressionPtr &expr) {
  * rep:   Replacement rule.
  */
 void Parser::define(const string &label, ReplacePtr &rep) {
-    if (expressions.count(label) > 0)
+    lock_guard<mutex> guard(lock);
+
+    if (expressions.count(label) > 0 || thunks.count(label) > 0)
         Error("An expression with the label '%s' has already been defined.", label.c_str());
     else if (rules.count(label) > 0)
         rules[label] = rep;
@@ -71,18 +124,93 @@ void Parser::define(const string &label, ReplacePtr &rep) {
         rules.insert({label, rep});
 }
 
+/**
+ * Returns native code for evaluating the given expression,
+ * or 'nullptr' if JIT compilation is disabled or fails.
+ * Expressions are compiled once per run (and cached on
+ * disk across runs), keyed by their fingerprints. If
+ * compilation fails, a warning is printed and JIT
+ * compilation is disabled for the rest of the run.
+ *
+ * expr: Expression to compile.
+ */
+NativeExpressionPtr Parser::native(ExpressionPtr &expr) {
+    uint64_t fp = expr->Fingerprint();
+
+    {
+        lock_guard<mutex> guard(lock);
+
+        if (!jit)
+            return nullptr;
+
+        unordered_map<uint64_t, NativeExpressionPtr>::iterator it = natives.find(fp);
+        if (it != natives.end())
+            return it->second;
+
+        if (!NativeExpression::IsAvailable()) {
+            Warning("No C compiler found (tried '%s'). Using the interpreted evaluator.", NativeExpression::GetCompiler().c_str());
+            jit = false;
+            return nullptr;
+        }
+    }
+
+    // Compile without holding the lock, so that other
+    // statements can run meanwhile. If another thread has
+    // compiled the same expression in the meantime, its
+    // code is used.
+    try {
+        NativeExpressionPtr ne(new NativeExpression(*expr, jitCache));
+
+        lock_guard<mutex> guard(lock);
+        return natives.insert(make_pair(fp, ne)).first->second;
+    } catch (SymachinException &ex) {
+        lock_guard<mutex> guard(lock);
+        if (jit) {
+            Warning("%s Using the interpreted evaluator.", ex.whats().c_str());
+            jit = false;
+        }
+
+        return nullptr;
+    }
+}
+
 /**
  * Evaluate the given expression numerically
- * with the given substitutions.
+ * with the given substitutions. If any symbols
+ * are given in 'wrt', the partial derivatives of
+ * the expression with respect to those symbols
+ * are printed as well.
  *
  * expr:  Expression to evaluate.
  * subst: Numeric substitutions to make.
  * other: Value to assign to tokens not in 'subst'.
+ * wrt:   Symbols to differentiate with respect to.
  */
-void Parser::evaluate(ExpressionPtr &expr, map<string, double> &subst, double other) {
-    double d = expr->Evaluate(subst, other);
+void Parser::evaluate(ExpressionPtr &expr, map<string, double> &subst, double other, const vector<string> &wrt) {
+    if (!wrt.empty()) {
+        CompiledExpression ce(*expr);
+        vector<unsigned int> slots;
+        for (vector<string>::const_iterator it = wrt.begin(); it != wrt.end(); it++)
+            slots.push_back(ce.GetSlot(*it));
+
+        vector<double> gradient(wrt.size());
+        double d = ce.EvaluateGradient(ce.Bind(subst, other).data(), slots, gradient.data());
+
+        *output << d << endl;
+        for (unsigned int k = 0; k < wrt.size(); k++)
+            *output << "d/d" << wrt[k] << " = " << gradient[k] << endl;
+
+        return;
+    }
 
-    cout << d << endl;
+    NativeExpressionPtr ne = native(expr);
+    double d;
+    if (ne != nullptr)
+        d = ne->Evaluate(subst, other);
+    else
+        d = CompiledExpression(*expr).Evaluate(subst, other);
+
+    *output << d << endl;
 }
 
 /**
@@ -96,12 +224,476 @@ void Parser::evaluate(ExpressionPtr &expr, map<string, double> &subst, double ot
  * other: Value to assign to tokens not in 'subst'.
  */
 void Parser::evaluate_assert(ExpressionPtr &expr, double val, map<string, double> &subst, double other) {
-    double d = expr->Evaluate(subst, other);
+    NativeExpressionPtr ne = native(expr);
+    double d;
+    if (ne != nullptr)
+        d = ne->Evaluate(subst, other);
+    else
+        d = CompiledExpression(*expr).Evaluate(subst, other);
 
     if (d != val)
         Error("Assertion failed. The expression did NOT evaluate to the expected value. Evaluated: %f, expected: %f.", d, val);
 }
 
+/**
+ * In lazy mode, record a thunk for the labels defined by
+ * the given statement instead of executing it. Returns
+ * 'false' if the statement has to be executed right away
+ * (i.e. if it has effects other than defining labels).
+ *
+ * st: Statement to defer.
+ */
+bool Parser::defer(Statement &st) {
+    switch (st.type) {
+        case Statement::APPLY:
+        case Statement::ASSIGN:
+        case Statement::GROUP:
+        case Statement::REPLACE:
+        case Statement::SUBSTITUTE:
+            break;
+        default:
+            return false;
+    }
+
+    ThunkPtr t(new Thunk(st));
+    vector<string> inputs = st.GetInputs(), outputs = st.GetOutputs();
+
+    if (st.type == Statement::APPLY)
+        t->rule = find_rule(st.names.front());
+
+    lock_guard<mutex> guard(lock);
+    for (vector<string>::iterator it = inputs.begin(); it != inputs.end(); it++) {
+        ThunkMap::iterator l = thunks.find(*it);
+        if (l != thunks.end())
+            t->inputs.insert(*l);
+    }
+
+    for (vector<string>::iterator it = outputs.begin(); it != outputs.end(); it++) {
+        if (rules.count(*it) > 0)
+            Error("A rule with the label '%s' has already been defined.", it->c_str());
+
+        thunks[*it] = t;
+    }
+
+    return true;
+}
+
+/**
+ * Drop the stored expression of the given label, which
+ * is about to be overwritten by the result of an operation
+ * on it, so that the expression can be updated in place if
+ * nothing else refers to it.
+ *
+ * label:  Label to drop.
+ * labels: Labels used by the statement.
+ */
+void Parser::drop(const string &label, LabelMap &labels) {
+    labels.erase(label);
+
+    lock_guard<mutex> guard(lock);
+    expressions.erase(label);
+}
+
+/**
+ * Execute the given statement.
+ *
+ * st: Statement to execute.
+ */
+void Parser::execute(Statement &st) {
+    LabelMap labels;
+    ReplacePtr rule;
+
+    // Attribute errors to the statement
+    position.filename = st.filename;
+    position.line = st.line;
+    position.charpos = st.charpos;
+    executing = true;
+    thunkValues = nullptr;
+
+    if (lazy && defer(st)) {
+        executing = false;
+        return;
+    }
+
+    // Look up the labels used by the statement, so that other
+    // statements may redefine labels while it is executing
+    vector<string> inputs = st.GetInputs();
+    if (lazy) {
+        ThunkMap used;
+        {
+            lock_guard<mutex> guard(lock);
+            for (vector<string>::iterator it = inputs.begin(); it != inputs.end(); it++) {
+                ThunkMap::iterator l = thunks.find(*it);
+                if (l != thunks.end())
+                    used.insert(*l);
+            }
+        }
+
+        for (ThunkMap::iterator it = used.begin(); it != used.end(); it++)
+            labels[it->first] = force(it->second, it->first);
+    } else {
+        lock_guard<mutex> guard(lock);
+        for (vector<string>::iterator it = inputs.begin(); it != inputs.end(); it++) {
+            LabelMap::iterator l = expressions.find(*it);
+            if (l != expressions.end())
+                labels.insert(*l);
+        }
+    }
+
+    if (st.type == Statement::APPLY)
+        rule = find_rule(st.names.front());
+
+    run(st, labels, rule);
+    executing = false;
+}
+
+/**
+ * Returns the rule of the given name.
+ *
+ * name: Name of the rule.
+ */
+ReplacePtr Parser::find_rule(const string &name) {
+    lock_guard<mutex> guard(lock);
+
+    unordered_map<string, ReplacePtr>::iterator it = rules.find(name);
+    if (it == rules.end())
+        Error("No rule named '%s' defined.", name.c_str());
+
+    return it->second;
+}
+
+/**
+ * Returns the value of the given label of the given
+ * thunk, executing the statement of the thunk (after
+ * forcing the thunks it depends on) if this has not
+ * been done yet. The thunks are forced from the bottom
+ * up, without recursion, since a label which is updated
+ * by every statement of a script gives a chain of thunks
+ * as long as the script.
+ *
+ * t:     Thunk defining the label.
+ * label: Label whose value to return.
+ */
+ExpressionPtr Parser::force(const ThunkPtr &t, const string &label) {
+    vector<ThunkPtr> order;
+    vector<pair<ThunkPtr, bool>> stack;
+    unordered_set<Thunk*> visited;
+
+    // Find the thunks which have not been evaluated in
+    // post-order (the inputs of a thunk before the thunk)
+    stack.push_back(make_pair(t, false));
+    while (!stack.empty()) {
+        ThunkPtr u = stack.back().first;
+
+        if (stack.back().second) {
+            order.push_back(u);
+            stack.pop_back();
+            continue;
+        }
+
+        if (!visited.insert(u.get()).second) {
+            stack.pop_back();
+            continue;
+        }
+
+        lock_guard<mutex> guard(u->lock);
+        if (u->evaluated) {
+            stack.pop_back();
+            continue;
+        }
+
+        stack.back().second = true;
+        for (ThunkMap::iterator it = u->inputs.begin(); it != u->inputs.end(); it++)
+            stack.push_back(make_pair(it->second, false));
+    }
+
+    for (vector<ThunkPtr>::iterator it = order.begin(); it != order.end(); it++) {
+        evaluate_thunk(*it);
+        it->reset();
+    }
+
+    lock_guard<mutex> guard(t->lock);
+    return t->values[label];
+}
+
+/**
+ * Execute the statement of the given thunk, unless it
+ * has already been evaluated. All thunks it depends on
+ * must have been evaluated (see 'force()').
+ *
+ * t: Thunk to evaluate.
+ */
+void Parser::evaluate_thunk(const ThunkPtr &t) {
+    lock_guard<mutex> guard(t->lock);
+
+    if (t->evaluated)
+        return;
+
+    LabelMap labels;
+    for (ThunkMap::iterator it = t->inputs.begin(); it != t->inputs.end(); it++) {
+        lock_guard<mutex> iguard(it->second->lock);
+        labels[it->first] = it->second->values[it->first];
+    }
+
+    // Errors are attributed to the deferred statement
+    token saved = position;
+    position.filename = t->statement.filename;
+    position.line = t->statement.line;
+    position.charpos = t->statement.charpos;
+    thunkValues = &t->values;
+
+    try {
+        run(t->statement, labels, t->rule);
+    } catch (ExpressionParserException &ex) {
+        Error(ex.whats());
+    } catch (FactorException &ex) {
+        Error(ex.whats());
+    }
+
+    thunkValues = nullptr;
+    position = saved;
+
+    t->evaluated = true;
+    t->inputs.clear();
+    t->rule.reset();
+}
+
+/**
+ * Carry out the given statement.
+ *
+ * st:     Statement to carry out.
+ * labels: Expressions of the labels used by the statement.
+ * rule:   Rule used by the statement (if any).
+ */
+void Parser::run(Statement &st, LabelMap &labels, ReplacePtr &rule) {
+    ExpressionPtr ep;
+
+    if (!st.expressions.empty() && st.type != Statement::PRINT)
+        ep = st.expressions.front()->Evaluate(labels);
+
+    switch (st.type) {
+        case Statement::APPLY:
+            if (st.IsUpdate())
+                drop(st.label, labels);
+
+            apply_to(st.label, rule, ep);
+            break;
+
+        case Statement::ASSERT: {
+            ExpressionPtr ep2 = st.expressions[1]->Evaluate(labels);
+            this->assert(ep, ep2);
+        } break;
+
+        case Statement::ASSIGN:
+            assign(st.label, ep);
+            break;
+
+        case Statement::DEFINE: {
+            ReplacePtr rep(new Replace());
+            for (unsigned int i = 0; i < st.names.size(); i++) {
+                if (i > 0)
+                    ep = st.expressions[i]->Evaluate(labels);
+
+                rep->CreateRule(Factor(st.names[i]), ep->GetTerms());
+            }
+
+            define(st.label, rep);
+        } break;
+
+        case Statement::EVAL:
+            evaluate(ep, st.values, st.otherValue, st.wrt);
+            break;
+
+        case Statement::EVAL_ASSERT:
+            evaluate_assert(ep, st.expected, st.values, st.otherValue);
+            break;
+
+        case Statement::EVAL_TABLE:
+            evaluate_table(ep, st.input, st.output, st.wrt);
+            break;
+
+        case Statement::EXPORT:
+            export_c(st.label, st.names, st.output, labels);
+            break;
+
+        case Statement::FREE:
+            release(st.names);
+            break;
+
+        case Statement::GROUP: {
+            vector<ExpressionPtr> exprs;
+            for (unsigned int i = 1; i < st.expressions.size(); i++)
+                exprs.push_back(st.expressions[i]->Evaluate(labels));
+
+            group_by(ep, exprs, st.names, st.otherLabel);
+        } break;
+
+        case Statement::PRINT:
+            print(st.expressions, labels);
+            break;
+
+        case Statement::PRINTF:
+            this->printf(ep);
+            break;
+
+        case Statement::PRINTN:
+            printn(ep);
+            break;
+
+        case Statement::REPLACE: {
+            ExpressionPtr ep2 = st.expressions[1]->Evaluate(labels);
+            if (st.IsUpdate())
+                drop(st.label, labels);
+
+            replace_in(st.label, st.names.front(), ep, ep2);
+        } break;
+
+        case Statement::SUBSTITUTE:
+            substitute(st.label, ep, st.substitute);
+            break;
+    }
+}
+
+/**
+ * Execute the given list of statements (which have
+ * been read earlier, or loaded from a cache). If parallel
+ * execution is enabled, independent statements are executed
+ * concurrently (see 'Scheduler').
+ *
+ * stmts: Statements to execute.
+ */
+void Parser::execute(vector<StatementPtr> &stmts) {
+    if (parallel) {
+        for (vector<StatementPtr>::iterator it = stmts.begin(); it != stmts.end(); it++)
+            declare(**it);
+
+        Scheduler::task run = [this](Statement &st, ostream &os) {
+            output = &os;
+            try {
+                execute(st);
+            } catch (ExpressionParserException &ex) {
+                Error(ex.whats());
+            } catch (FactorException &ex) {
+                Error(ex.whats());
+            }
+        };
+
+        try {
+            Scheduler(stmts, run, cout, nthreads).Run();
+        } catch (...) {
+            output = &cout;
+            throw;
+        }
+
+        output = &cout;
+        return;
+    }
+
+    try {
+        for (vector<StatementPtr>::iterator it = stmts.begin(); it != stmts.end(); it++) {
+            declare(**it);
+            execute(**it);
+        }
+    } catch (ExpressionParserException &ex) {
+        Error(ex.whats());
+    } catch (FactorException &ex) {
+        Error(ex.whats());
+    }
+}
+
+/**
+ * Generate a C function evaluating the given
+ * expressions numerically.
+ *
+ * funcname: Name of the C function.
+ * refs:     Labels of the expressions to evaluate.
+ * fname:    Name of file to write the code to. If empty,
+ *           the code is written to stdout.
+ * labels:   Expressions of the labels.
+ */
+void Parser::export_c(const string &funcname, const vector<string> &refs, const string &fname, const LabelMap &labels) {
+    CodeGenerator cg(funcname);
+    for (vector<string>::const_iterator it = refs.begin(); it != refs.end(); it++) {
+        LabelMap::const_iterator l = labels.find(*it);
+        if (l == labels.end())
+            Error("No expression with the label '%s' has been defined.", it->c_str());
+
+        cg.Add(*it, *l->second);
+    }
+
+    string code = cg.Generate();
+    if (fname.empty())
+        *output << code;
+    else {
+        ofstream f(fname);
+        if (!f.is_open())
+            Error("Unable to open file for writing: %s.", fname.c_str());
+
+        f << code;
+    }
+}
+
+/**
+ * Evaluate the given expression numerically at
+ * every point (row) of the given table, and write
+ * the results to a table in the same format. Symbols
+ * which do not have a column in the table are
+ * assigned the value '1'. The partial derivatives
+ * with respect to the symbols in 'wrt' are written
+ * to the columns 'd/d<symbol>'.
+ *
+ * expr:    Expression to evaluate.
+ * infile:  Name of file containing the table of points.
+ * outfile: Name of file to write results to.
+ * wrt:     Symbols to differentiate with respect to.
+ */
+void Parser::evaluate_table(ExpressionPtr &expr, const string &infile, const string &outfile, const vector<string> &wrt) {
+    Table in;
+    try {
+        in.Read(infile);
+    } catch (SymachinException &ex) {
+        Error(ex.whats());
+    }
+
+    // Derivatives are only computed by the interpreted evaluator
+    NativeExpressionPtr ne = (wrt.empty() ? native(expr) : nullptr);
+    CompiledExpressionPtr ce;
+    if (ne == nullptr)
+        ce = CompiledExpressionPtr(new CompiledExpression(*expr));
+
+    const vector<string> &symbols = (ne != nullptr ? ne->GetSymbols() : ce->GetSymbols());
+    vector<double> ones(in.NumberOfRows(), 1.0);
+    vector<const double*> columns(symbols.size());
+
+    for (unsigned int s = 0; s < symbols.size(); s++) {
+        const vector<double> *col = in.GetColumn(symbols[s]);
+        columns[s] = (col == nullptr ? ones.data() : col->data());
+    }
+
+    // Column buffers stay in place when more columns are added
+    Table out(in.NumberOfRows(), in.IsBinary());
+    double *values = out.AddColumn("value").data();
+    if (!wrt.empty()) {
+        vector<unsigned int> slots;
+        vector<double*> gradients;
+        for (vector<string>::const_iterator it = wrt.begin(); it != wrt.end(); it++) {
+            slots.push_back(ce->GetSlot(*it));
+            gradients.push_back(out.AddColumn("d/d"+*it).data());
+        }
+
+        ce->EvaluateGradient(columns.data(), in.NumberOfRows(), slots, values, gradients.data(), nthreads);
+    } else if (ne != nullptr)
+        ne->Evaluate(columns.data(), in.NumberOfRows(), values, nthreads);
+    else
+        ce->Evaluate(columns.data(), in.NumberOfRows(), values, nthreads);
+
+    try {
+        out.Write(outfile);
+    } catch (SymachinException &ex) {
+        Error(ex.whats());
+    }
+}
+
 /**
  * Group the given expression by the given factor.
  *
@@ -132,34 +724,34 @@ void Parser::group_by(ExpressionPtr &expr, vector<ExpressionPtr> &terms, vector<
         if (grouped->size() > i)
             assign(otherlbl, grouped->at(i));
         else {
-            ExpressionPtr ep(new Expression("0"));
+            Term zero("0");
+            ExpressionPtr ep(new Expression(zero));
             assign(otherlbl, ep);
         }
     }
 }
 
 /**
- * Print the coming sequence of tokens.
+ * Print the given sequence of words and labels.
+ *
+ * items:  Symbols (printed as is) and references
+ *         (whose expressions are printed).
+ * labels: Expressions of the labels.
  */
-void Parser::print() {
-    while (peek() != token::ENDSTATEMENT) {
-        if (expect(
-                token::WORD, token::REFERENCE, token::PLUS,
-                token::MINUS, token::MULTIPLICATION,
-                token::LPAR, token::RPAR
-            ) == token::REFERENCE
-        ) {
-            token *tkn = gtkn();
-            if (expressions.count(tkn->text) == 0)
-                Error("No expression with the label '%s' has been defined.", tkn->text.c_str());
+void Parser::print(const vector<ExpressionTreePtr> &items, const LabelMap &labels) {
+    for (vector<ExpressionTreePtr>::const_iterator it = items.begin(); it != items.end(); it++) {
+        const string &text = (*it)->GetText();
+        if ((*it)->GetType() == ExpressionTree::REFERENCE) {
+            LabelMap::const_iterator l = labels.find(text);
+            if (l == labels.end())
+                Error("No expression with the label '%s' has been defined.", text.c_str());
 
-            cout << expressions[tkn->text]->ToString() << " ";
+            *output << l->second->ToString() << " ";
         } else
-            cout << gtkn()->text << " ";
+            *output << text << " ";
     }
 
-    expect(token::ENDSTATEMENT);
-    cout << endl;
+    *output << endl;
 }
 
 /**
@@ -167,7 +759,7 @@ void Parser::print() {
  */
 void Parser::printf(ExpressionPtr &ep) {
     string s = ep->ToString(true);
-    cout << s << endl;
+    *output << s << endl;
 }
 
 /**
@@ -176,27 +768,68 @@ void Parser::printf(ExpressionPtr &ep) {
 void Parser::printn(ExpressionPtr &ep) {
     unsigned int n = ep->NumberOfTerms();
     if (n == 1 && ep->GetTerms()->front()->IsZero()) {
-        cout << "0\n";
+        *output << "0\n";
     } else {
-        cout << ep->NumberOfTerms() << endl;
+        *output << ep->NumberOfTerms() << endl;
     }
 }
 
 /**
- * Replace single factor in expression.
+ * Drop the expressions of the given labels.
+ *
+ * labels: Labels to drop.
+ */
+void Parser::release(const vector<string> &labels) {
+    lock_guard<mutex> guard(lock);
+
+    for (vector<string>::const_iterator it = labels.begin(); it != labels.end(); it++) {
+        expressions.erase(*it);
+        thunks.erase(*it);
+    }
+}
+
+/**
+ * Replace single factor in expression. If nothing
+ * else refers to the expression, it is updated in place.
  *
  * label: Label to assign result to.
  * fac:   Factor to replace.
- * repl:  (string) Expression to replace the factor with.
+ * repl:  Expression to replace the factor with.
  * expr:  Expression to do the replacement in.
  */
 void Parser::replace_in(
-    const string &label, const string &fac, const string &repl, ExpressionPtr expr
+    const string &label, const string &fac, ExpressionPtr &repl, ExpressionPtr &expr
 ) {
     ReplacePtr rp(new Replace());
 
-    rp->CreateRule(fac, repl);
+    rp->CreateRule(Factor(fac), repl->GetTerms());
+    if (expr.use_count() == 1) {
+        rp->OperateInPlace(*expr);
+        assign(label, expr);
+        return;
+    }
+
     ExpressionPtr rexpr = rp->Operate(*expr);
     assign(label, rexpr);
 }
 
+/**
+ * Substitute numeric values for some of the symbols
+ * of the given expression, and assign the result to
+ * the given label. It is an error for the result to
+ * have non-integer coefficients.
+ *
+ * label: Label to assign the result to.
+ * expr:  Expression to substitute values into.
+ * sub:   Values to substitute.
+ */
+void Parser::substitute(const string &label, ExpressionPtr &expr, SubstitutePtr &sub) {
+    ExpressionPtr sexpr;
+    try {
+        sexpr = sub->Operate(*expr);
+    } catch (SymachinException &ex) {
+        Error(ex.whats());
+    }
+
+    assign(label, sexpr);
+}
@@ -2,34 +2,82 @@
  * Implementation of the 'Parser' class.
  */
 
+#include <algorithm>
+#include <iostream>
 #include <string>
 #include <sstream>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include "interpreter/Lexer.h"
 #include "interpreter/Parser.h"
+#include "interpreter/ScriptCache.h"
 #include "symachin/ExpressionParserException.h"
+#include "symachin/FactorException.h"
+#include "symachin/SymachinException.h"
 
 using namespace std;
 using namespace symachin;
 
+const string Parser::emptyFilename;
+thread_local token Parser::position = { lex_text(), &emptyFilename, 0, 0, token::UNKNOWN };
+thread_local bool Parser::executing = false;
+thread_local ostream *Parser::output = &cout;
+thread_local LabelMap *Parser::thunkValues = nullptr;
+
 /**
- * Load the given list of tokens and
- * prepare to parse it.
+ * Enable/disable modular mode. In modular mode, all
+ * numeric coefficients are reduced modulo a large prime
+ * (see 'FiniteField'), and failed assertions are reported
+ * without stopping execution. This allows to cheaply check
+ * whether the assertions of a script would succeed.
  */
-void Parser::LoadTokens(vector<token*> *tokens) {
-    tokenlist = tokens;
-    tknindex = 0;
+void Parser::SetModular(bool m) {
+    modular = m;
+    Factor::SetModularArithmetic(m);
 }
 
 /**
  * Parse (after lexing) the contents of the given file.
+ * If the script cache is enabled, the statements of the
+ * file are loaded from the cache if it is up to date, and
+ * otherwise the whole file is parsed (and the cache
+ * updated) before any statement is executed. The whole
+ * file is also parsed first when executing in parallel,
+ * or when labels are freed after their last use (see
+ * 'free_dead()').
  */
 void Parser::ParseFile(const string &fname) {
     Lexer lex;
-    vector<token*> *tokens = lex.LexFile(fname);
-    Parse(tokens);
+    if (!scriptCache && !parallel && !freeLabels) {
+        lex.LoadFile(fname);
+        Parse(lex);
+        return;
+    }
+
+    vector<StatementPtr> stmts;
+
+    if (!scriptCache) {
+        lex.LoadFile(fname);
+        statements(lex, stmts);
+    } else {
+        ScriptCache cache(fname);
+        if (!cache.Load(stmts, filenames)) {
+            lex.LoadFile(fname);
+            statements(lex, stmts);
+
+            try {
+                cache.Save(lex.GetFiles(), stmts);
+            } catch (SymachinException &ex) {
+                Warning("Unable to cache script: %s", ex.whats().c_str());
+            }
+        }
+    }
+
+    if (freeLabels)
+        free_dead(stmts);
 
-    delete tokens;
+    execute(stmts);
 }
 
 /**
@@ -37,211 +85,365 @@ void Parser::ParseFile(const string &fname) {
  */
 void Parser::Parse(string &contents) {
     Lexer lex;
-    vector<token*> *tokens = lex.Lex(contents, "<string>");
-    Parse(tokens);
-
-    delete tokens;
+    lex.Load(contents, "<string>");
+    Parse(lex);
 }
 
 /**
- * Parse the given list of tokens.
+ * Parse the tokens produced by the given lexer,
+ * executing each statement as soon as it has been read.
  */
-void Parser::Parse(vector<token*> *tokens) {
-    token *tkn;
-    LoadTokens(tokens);
-    
+void Parser::Parse(Lexer &lex) {
+    StatementPtr st;
+
+    lexer = &lex;
+    lookahead.clear();
+    hasLast = false;
+    executing = false;
+
     try {
-        while ((tkn=advance())->type != token::ENDOFSTREAM) {
-            // Handle label
-            if (tkn->type == token::LABEL) {
-                currentlabel = tkn->text;
-                tkn = advance();
-            }
+        while ((st=statement()) != nullptr)
+            execute(*st);
+    } catch (ExpressionParserException &ex) {
+        Error(ex.whats());
+    } catch (FactorException &ex) {
+        Error(ex.whats());
+    }
 
-            switch (tkn->type) {
-                // : <expr>
-                case token::ASSIGN: {
-                    expect(token::EXPRESSION);
-                    require_label();
+    lexer = nullptr;
+}
 
-                    ExpressionPtr ep(new Expression(gtkn()->text));
-                    assign(currentlabel, ep);
-                } break;
+/**
+ * Read all statements produced by the given lexer,
+ * without executing them.
+ *
+ * lex:   Lexer to read tokens from.
+ * stmts: List to append the statements to.
+ */
+void Parser::statements(Lexer &lex, vector<StatementPtr> &stmts) {
+    StatementPtr st;
 
-                // APPLY <ref> TO <expr>
-                case token::APPLY: {
-                    string refr;
-                    expect(token::REFERENCE);
-                    refr = gtkn()->text;
+    lexer = &lex;
+    lookahead.clear();
+    hasLast = false;
+    executing = false;
 
-                    expect(token::TO);
-                    expect(token::EXPRESSION);
-                    ExpressionPtr ep(new Expression(gtkn()->text));
+    try {
+        while ((st=statement()) != nullptr)
+            stmts.push_back(st);
+    } catch (ExpressionParserException &ex) {
+        Error(ex.whats());
+    } catch (FactorException &ex) {
+        Error(ex.whats());
+    }
 
-                    require_label();
+    lexer = nullptr;
+}
 
-                    apply_to(currentlabel, refr, ep);
-                } break;
+/**
+ * Read the next statement from the token stream.
+ * Returns 'nullptr' at the end of the stream. The
+ * expressions of the statement are folded as far as
+ * possible (see 'ExpressionTree::Fold()').
+ */
+StatementPtr Parser::statement() {
+    token *tkn;
+    StatementPtr st;
 
-                // ASSERT <expr> = <expr>;
-                case token::ASSERT: {
-                    expect_expression(token::EQUALS);
-                    ExpressionPtr ep1(new Expression(gtkn()->text));
+    if ((tkn=advance())->type == token::ENDOFSTREAM)
+        return nullptr;
 
-                    expect_expression();
-                    ExpressionPtr ep2(new Expression(gtkn()->text));
+    // Handle label
+    currentlabel.clear();
+    if (tkn->type == token::LABEL) {
+        currentlabel = tkn->text;
+        tkn = advance();
+    }
 
-                    this->assert(ep1, ep2);
-                } break;
+    switch (tkn->type) {
+        // : <expr>
+        case token::ASSIGN: {
+            st = StatementPtr(new Statement(Statement::ASSIGN, currentlabel));
+            st->expressions.push_back(expression());
+
+            require_label();
+        } break;
+
+        // APPLY <ref> TO <expr>
+        case token::APPLY: {
+            st = StatementPtr(new Statement(Statement::APPLY, currentlabel));
+            expect(token::REFERENCE);
+            st->names.push_back(gtkn()->text);
+
+            expect(token::TO);
+            st->expressions.push_back(expression());
+
+            require_label();
+        } break;
+
+        // ASSERT <expr> = <expr>;
+        case token::ASSERT: {
+            st = StatementPtr(new Statement(Statement::ASSERT, currentlabel));
+            st->expressions.push_back(expression(token::EQUALS));
+            st->expressions.push_back(expression());
+        } break;
+
+        // DEFINE ... END
+        case token::DEFINE: {
+            st = StatementPtr(new Statement(Statement::DEFINE, currentlabel));
+
+            do {
+                expect(token::WORD);
+                st->names.push_back(gtkn()->text);
+
+                expect(token::RARROW);
+                st->expressions.push_back(expression());
+            } while (peek() != token::END);
+            expect(token::END);
+
+            require_label();
+        } break;
+
+        // EVAL <expr> WITH ... END
+        // EVAL <expr> WITH ... ASSERT <number>
+        // EVAL <expr> WITH <word> TO <word>;
+        // EVAL <expr> WITH <word> TO <word> WRT <word> ...;
+        // (with 'WRT <word> ...;' allowed among substitutions)
+        case token::EVAL: {
+            st = StatementPtr(new Statement(Statement::EVAL, currentlabel));
+            st->expressions.push_back(expression(token::WITH));
+
+            if (peek(1) == token::TO) {
+                st->type = Statement::EVAL_TABLE;
+
+                expect(token::WORD);
+                st->input = gtkn()->text;
+
+                expect(token::TO);
+                expect(token::WORD);
+                st->output = gtkn()->text;
+
+                if (peek() == token::WRT) {
+                    expect(token::WRT);
+                    do {
+                        expect(token::WORD);
+                        st->wrt.push_back(gtkn()->text);
+                    } while (peek() != token::ENDSTATEMENT);
+                }
 
-                // DEFINE ... END
-                case token::DEFINE: {
-                    string wrd;
-                    ReplacePtr rep(new Replace());
+                expect(token::ENDSTATEMENT);
+                break;
+            }
 
+            map<string, double> &subst = st->values;
+            do {
+                if (peek() == token::WRT) {
+                    expect(token::WRT);
                     do {
                         expect(token::WORD);
-                        wrd = gtkn()->text;
+                        st->wrt.push_back(gtkn()->text);
+                    } while (peek() != token::ENDSTATEMENT);
 
-                        expect(token::RARROW);
-                        expect(token::EXPRESSION);
+                    expect(token::ENDSTATEMENT);
+                    continue;
+                }
 
-                        rep->CreateRule(wrd, gtkn()->text);
-                    } while (peek() != token::END);
-                    expect(token::END);
+                string sub;
+                if (expect(token::WORD, token::OTHER) != token::OTHER)
+                    sub = gtkn()->text;
 
-                    require_label();
-                    define(currentlabel, rep);
-                } break;
+                expect(token::EQUALS);
+                expect(token::WORD);
 
-                // EVAL <expr> WITH ... END
-                // EVAL <expr> WITH ... ASSERT <number>
-                case token::EVAL: {
-                    expect_expression(token::WITH);
-                    ExpressionPtr ep(new Expression(gtkn()->text));
-                    map<string, double> subst;
-                    double otherval = 1.0;
+                string val = gtkn()->text;
+                double dval;
+                if (is_number(val))
+                    dval = stod(val);
+                else if (subst.find(val) != subst.end())
+                    dval = subst[val];
+                else
+                    Error("Unrecognized value on RHS of expression: '%s'.", val.c_str());
 
-                    do {
-                        string sub;
-                        if (expect(token::WORD, token::OTHER) != token::OTHER)
-                            sub = gtkn()->text;
+                if (sub.empty())
+                    st->otherValue = dval;
+                else
+                    subst[sub] = dval;
 
-                        expect(token::EQUALS);
-                        expect(token::WORD);
+                expect(token::ENDSTATEMENT);
 
-                        string val = gtkn()->text;
-                        double dval;
-                        if (is_number(val))
-                            dval = stod(val);
-                        else if (subst.find(val) != subst.end())
-                            dval = subst[val];
-                        else
-                            Error("Unrecognized value on RHS of expression: '%s'.", val.c_str());
+            } while (peek() != token::END && peek() != token::ASSERT);
 
-                        if (sub.empty())
-                            otherval = dval;
-                        else
-                            subst[sub] = dval;
+            if (expect(token::ASSERT, token::END) == token::ASSERT) {
+                if (!st->wrt.empty())
+                    Error("'wrt' cannot be combined with 'assert'.");
 
-                        expect(token::ENDSTATEMENT);
+                expect(token::WORD);
+                string num = gtkn()->text;
 
-                    } while (peek() != token::END && peek() != token::ASSERT);
+                if (!is_number(num))
+                    Error("Expected numeric value after 'assert'.");
 
-                    if (expect(token::ASSERT, token::END) == token::ASSERT) {
-                        expect(token::WORD);
-                        string num = gtkn()->text;
+                st->type = Statement::EVAL_ASSERT;
+                st->expected = stod(num);
 
-                        if (!is_number(num))
-                            Error("Expected numeric value after 'assert'.");
+                expect(token::ENDSTATEMENT);
+            }
+        } break;
+
+        // EXPORT <ref> <ref> ... ;
+        // EXPORT <ref> <ref> ... TO <word>;
+        case token::EXPORT: {
+            st = StatementPtr(new Statement(Statement::EXPORT, currentlabel));
+
+            do {
+                expect(token::REFERENCE);
+                st->names.push_back(gtkn()->text);
+            } while (peek() == token::REFERENCE);
+
+            if (expect(token::TO, token::ENDSTATEMENT) == token::TO) {
+                expect(token::WORD);
+                st->output = gtkn()->text;
+                expect(token::ENDSTATEMENT);
+            }
 
-                        double val = stod(num);
+            require_label();
+        } break;
+
+        // FREE <ref> <ref> ... ;
+        case token::FREE: {
+            st = StatementPtr(new Statement(Statement::FREE, currentlabel));
+
+            do {
+                expect(token::REFERENCE);
+                tkn = gtkn();
+                if (defined.count(tkn->text) == 0)
+                    Error("Label '%s' has not been defined.", tkn->text.str().c_str());
+
+                st->names.push_back(tkn->text);
+            } while (peek() == token::REFERENCE);
+
+            expect(token::ENDSTATEMENT);
+        } break;
+
+        // GROUP <expr> BY ... END
+        case token::GROUP: {
+            st = StatementPtr(new Statement(Statement::GROUP, currentlabel));
+            st->expressions.push_back(expression(token::BY));
+
+            string sublbl;
+            do {
+                expect(token::LABEL);
+                if (currentlabel.empty())
+                    sublbl = gtkn()->text;
+                else
+                    sublbl = currentlabel + "." + gtkn()->text.str();
+
+                if (peek() == token::OTHER) {
+                    expect(token::OTHER);
+                    st->otherLabel = sublbl;
+                    expect(token::ENDSTATEMENT);
+                } else {
+                    st->expressions.push_back(expression());
+                    st->names.push_back(sublbl);
+                }
+            } while (peek() != token::END);
+
+            expect(token::END);
+        } break;
+
+        // PRINT <word|ref> ...;
+        case token::PRINT: {
+            st = StatementPtr(new Statement(Statement::PRINT, currentlabel));
+
+            while (peek() != token::ENDSTATEMENT) {
+                if (expect(
+                        token::WORD, token::REFERENCE, token::PLUS,
+                        token::MINUS, token::MULTIPLICATION,
+                        token::LPAR, token::RPAR
+                    ) == token::REFERENCE
+                ) {
+                    tkn = gtkn();
+                    if (defined.count(tkn->text) == 0)
+                        Error("No expression with the label '%s' has been defined.", tkn->text.str().c_str());
+
+                    st->expressions.push_back(ExpressionTreePtr(new ExpressionTree(ExpressionTree::REFERENCE, tkn->text)));
+                } else
+                    st->expressions.push_back(ExpressionTreePtr(new ExpressionTree(ExpressionTree::SYMBOL, gtkn()->text)));
+            }
 
-                        expect(token::ENDSTATEMENT);
+            expect(token::ENDSTATEMENT);
+        } break;
+
+        // PRINTF <expr>
+        case token::PRINTF: {
+            st = StatementPtr(new Statement(Statement::PRINTF, currentlabel));
+            st->expressions.push_back(expression());
+        } break;
+
+        // PRINTN <expr>
+        case token::PRINTN: {
+            st = StatementPtr(new Statement(Statement::PRINTN, currentlabel));
+            st->expressions.push_back(expression());
+        } break;
+
+        // REPLACE <word> -> <expr> IN <expr>;
+        case token::REPLACE: {
+            st = StatementPtr(new Statement(Statement::REPLACE, currentlabel));
+            expect(token::WORD);
+            st->names.push_back(gtkn()->text);
+
+            expect(token::RARROW);
+            st->expressions.push_back(expression(token::IN));
+            st->expressions.push_back(expression());
+
+            require_label();
+        } break;
+
+        // SUBSTITUTE <expr> WITH <word> = <word>; ... END
+        case token::SUBSTITUTE: {
+            st = StatementPtr(new Statement(Statement::SUBSTITUTE, currentlabel));
+            st->expressions.push_back(expression(token::WITH));
+            st->substitute = SubstitutePtr(new Substitute());
+
+            do {
+                expect(token::WORD);
+                string sym = gtkn()->text;
+
+                expect(token::EQUALS);
+                string val;
+                if (expect(token::MINUS, token::WORD) == token::MINUS) {
+                    expect(token::WORD);
+                    val = "-";
+                }
+                val += gtkn()->text;
 
-                        evaluate_assert(ep, val, subst, otherval);
-                    } else
-                        evaluate(ep, subst, otherval);
+                try {
+                    st->substitute->SetValue(sym, val);
+                } catch (SymachinException &ex) {
+                    Error(ex.whats());
+                }
 
-                } break;
+                expect(token::ENDSTATEMENT);
+            } while (peek() != token::END);
 
-                // GROUP <expr> BY ... END
-                case token::GROUP: {
-                    expect_expression(token::BY);
-                    ExpressionPtr ep(new Expression(gtkn()->text));
-                    vector<ExpressionPtr> exprs;
-                    vector<string> labels;
-                    string sublbl, otherlbl;
+            expect(token::END);
+            require_label();
+        } break;
 
-                    do {
-                        expect(token::LABEL);
-                        if (currentlabel.empty())
-                            sublbl = gtkn()->text;
-                        else
-                            sublbl = currentlabel + "." + gtkn()->text;
-
-                        if (peek() == token::OTHER) {
-                            expect(token::OTHER);
-                            otherlbl = sublbl;
-                            expect(token::ENDSTATEMENT);
-                        } else {
-                            expect(token::EXPRESSION);
-                            exprs.push_back(ExpressionPtr(new Expression(gtkn()->text)));
-                            labels.push_back(sublbl);
-                        }
-                    } while (peek() != token::END);
-
-                    group_by(ep, exprs, labels, otherlbl);
-                    expect(token::END);
-                } break;
-
-                // PRINT <expr>
-                case token::PRINT: {
-                    print();
-                } break;
-
-                // PRINTF <expr>
-                case token::PRINTF: {
-                    expect(token::EXPRESSION);
-                    ExpressionPtr ep(new Expression(gtkn()->text));
-
-                    this->printf(ep);
-                } break;
-
-                // PRINTN <expr>
-                case token::PRINTN: {
-                    expect(token::EXPRESSION);
-                    ExpressionPtr ep(new Expression(gtkn()->text));
-
-                    printn(ep);
-                } break;
-
-                // REPLACE <word> -> <expr> IN <expr>;
-                case token::REPLACE: {
-                    expect(token::WORD);
-                    string wrd = gtkn()->text;
+        default:
+            Error("Unexpected token: %s.", tkn->ToString().c_str());
+    }
 
-                    expect(token::RARROW);
-                    expect_expression(token::IN);
-                    string repl = gtkn()->text;
+    st->filename = &(*filenames.insert(*last.filename).first);
+    st->line = last.line;
+    st->charpos = last.charpos;
 
-                    expect_expression();
-                    ExpressionPtr ep(new Expression(gtkn()->text));
-                    
-                    require_label();
+    for (vector<ExpressionTreePtr>::iterator it = st->expressions.begin(); it != st->expressions.end(); it++)
+        *it = ExpressionTree::Fold(*it, nthreads);
 
-                    replace_in(currentlabel, wrd, repl, ep);
-                } break;
+    declare(*st);
 
-                default:
-                    Error("Unexpected token: %s.", tkn->ToString().c_str());
-            }
-        
-            currentlabel.clear();
-        }
-    } catch (ExpressionParserException &ex) {
-        Error(ex.whats());
-    }
+    return st;
 }
 
 /**********************
@@ -252,10 +454,14 @@ void Parser::Parse(vector<token*> *tokens) {
  * Returns the type of the reached token.
  */
 token *Parser::advance() {
-    if (tknindex >= tokenlist->size())
+    if (!fill(0))
         return &endtkn;
-    
-    return tokenlist->at(tknindex++);
+
+    last = lookahead.front();
+    lookahead.pop_front();
+    hasLast = true;
+
+    return &last;
 }
 
 /**
@@ -264,89 +470,228 @@ token *Parser::advance() {
  * of the expected type.
  */
 ttype Parser::expect(ttype t) {
-    if (t == token::EXPRESSION)
-        return expect_expression();
-
-    if (tknindex >= tokenlist->size())
+    if (!fill(0))
         Error("Unexpected end of token stream.");
-    token *tkn = tokenlist->at(tknindex);
+    token *tkn = &lookahead.front();
 
     if (tkn->type != t)
         Error("Unexpected token '%s'.", tkn->ToString().c_str());
 
-    tknindex++;
-    return tkn->type;
+    return advance()->type;
 }
 
 /**
- * Expect the following sequence of tokens to
- * be part of an expression. Read them as such
- * and return a single 'EXPRESSION' token.
+ * Read the following sequence of tokens as an
+ * expression, ended by the given token.
  *
  * statend: Token to use to end statement (default: ENDSTATEMENT)
  */
-ttype Parser::expect_expression(ttype statend) {
-    ttype t;
-    token *rtkn = new token;
-    rtkn->type = token::EXPRESSION;
-
-    vector<token*>::iterator bt = tokenlist->begin()+tknindex;
-    long _tknindex = tknindex;
-
-    rtkn->filename = (*bt)->filename;
-    rtkn->charpos = (*bt)->charpos;
-    rtkn->line = (*bt)->line;
-
-    while (
-        (t=expect(
-            token::WORD, token::REFERENCE, token::PLUS,
-            token::MINUS, token::MULTIPLICATION,
-            token::LPAR, token::RPAR, statend
-        )) != statend
-    ) {
-        token *tkn = gtkn();
-
-        if (t == token::REFERENCE) {   // Insert referenced expression
-            if (expressions.count(tkn->text) == 0)
-                Error("Label '%s' has not been defined.", tkn->text.c_str());
-
-            ExpressionPtr ep = expressions[tkn->text];
-            string s = ep->ToString();
-            string q;
-            if (s[0] == '-')
-                q = "(0" + s + ")";
-            else
-                q = "(" + s + ")";
-
-            rtkn->text += q;
-        } else  // Just append token contents
-            rtkn->text += tkn->text;
-
-        // This token will be erased later, so delete
-        // the pointer to it now.
-        delete tkn;
+ExpressionTreePtr Parser::expression(ttype statend) {
+    ExpressionTreePtr tree = expression_sum();
+    expect(statend);
+
+    return tree;
+}
+
+/**
+ * Read a sum (or difference) of products, optionally
+ * preceded by a sign. All products are read into a single
+ * 'SUM' node.
+ */
+ExpressionTreePtr Parser::expression_sum() {
+    vector<ExpressionTreePtr> operands;
+    vector<bool> negated;
+    ttype t = peek();
+
+    if (t == token::PLUS || t == token::MINUS)
+        advance();
+    else
+        t = token::PLUS;
+
+    for (;;) {
+        operands.push_back(expression_product());
+        negated.push_back(t == token::MINUS);
+
+        if ((t=peek()) != token::PLUS && t != token::MINUS)
+            break;
+
+        advance();
+    }
+
+    if (operands.size() == 1 && !negated.front())
+        return operands.front();
+
+    return ExpressionTreePtr(new ExpressionTree(ExpressionTree::SUM, operands, negated));
+}
+
+/**
+ * Read a product of factors into a single 'PRODUCT' node.
+ */
+ExpressionTreePtr Parser::expression_product() {
+    vector<ExpressionTreePtr> operands;
+    operands.push_back(expression_factor());
+
+    while (peek() == token::MULTIPLICATION) {
+        advance();
+        operands.push_back(expression_factor());
+    }
+
+    if (operands.size() == 1)
+        return operands.front();
+
+    return ExpressionTreePtr(new ExpressionTree(ExpressionTree::PRODUCT, operands));
+}
+
+/**
+ * Read a single factor of an expression: a symbol,
+ * a reference or a parenthesized expression.
+ */
+ExpressionTreePtr Parser::expression_factor() {
+    ttype t = expect(token::WORD, token::REFERENCE, token::LPAR);
+    token *tkn = gtkn();
+
+    if (t == token::WORD)
+        return ExpressionTreePtr(new ExpressionTree(ExpressionTree::SYMBOL, tkn->text));
+    else if (t == token::REFERENCE) {
+        if (defined.count(tkn->text) == 0)
+            Error("Label '%s' has not been defined.", tkn->text.str().c_str());
+
+        return ExpressionTreePtr(new ExpressionTree(ExpressionTree::REFERENCE, tkn->text));
+    } else {
+        ExpressionTreePtr tree = expression_sum();
+        expect(token::RPAR);
+
+        return tree;
+    }
+}
+
+/**
+ * Register the labels defined by the given statement,
+ * so that references to them can be checked while the
+ * following statements are read.
+ *
+ * st: Statement which has been read.
+ */
+void Parser::declare(const Statement &st) {
+    switch (st.type) {
+        case Statement::APPLY:
+        case Statement::ASSIGN:
+        case Statement::REPLACE:
+        case Statement::SUBSTITUTE:
+            defined.insert(st.label);
+            break;
+        case Statement::FREE:
+            for (vector<string>::const_iterator it = st.names.begin(); it != st.names.end(); it++)
+                defined.erase(*it);
+            break;
+        case Statement::GROUP:
+            defined.insert(st.names.begin(), st.names.end());
+            if (!st.otherLabel.empty())
+                defined.insert(st.otherLabel);
+            break;
+        default: break;
     }
+}
+
+/**
+ * Insert 'free' statements into the given list of
+ * statements right after the last use of each label
+ * (before it is redefined, or the list ends), so that
+ * the expressions of labels are dropped as soon as they
+ * are no longer needed. Labels which are defined but
+ * never used are dropped right after their definition.
+ *
+ * stmts: Statements of a script.
+ */
+void Parser::free_dead(vector<StatementPtr> &stmts) const {
+    vector<StatementPtr> result;
+    // Labels which are used later (before being redefined)
+    unordered_set<string> live, ruleNames;
+
+    for (unordered_map<string, ReplacePtr>::const_iterator it = rules.begin(); it != rules.end(); it++)
+        ruleNames.insert(it->first);
+    for (vector<StatementPtr>::const_iterator it = stmts.begin(); it != stmts.end(); it++) {
+        if ((*it)->type == Statement::DEFINE)
+            ruleNames.insert((*it)->label);
+    }
+
+    // Go through the statements backwards, so that 'live'
+    // holds the labels used after the current statement
+    for (vector<StatementPtr>::const_reverse_iterator it = stmts.rbegin(); it != stmts.rend(); it++) {
+        const Statement &st = **it;
+        vector<string> inputs = st.GetInputs(), outputs = st.GetOutputs();
+        StatementPtr fr(new Statement(Statement::FREE, ""));
+
+        if (st.type != Statement::FREE) {
+            vector<string> used(outputs);
+            used.insert(used.end(), inputs.begin(), inputs.end());
+
+            for (vector<string>::iterator jt = used.begin(); jt != used.end(); jt++) {
+                if (live.count(*jt) == 0 && ruleNames.count(*jt) == 0 &&
+                    find(fr->names.begin(), fr->names.end(), *jt) == fr->names.end())
+                    fr->names.push_back(*jt);
+            }
+        }
 
-    // Token will be erased next, so delete now
-    if (t == statend)
-        delete gtkn();
+        for (vector<string>::iterator jt = outputs.begin(); jt != outputs.end(); jt++)
+            live.erase(*jt);
+        live.insert(inputs.begin(), inputs.end());
 
-    // Erase old tokens
-    tokenlist->erase(bt, tokenlist->begin()+tknindex);
+        if (!fr->names.empty()) {
+            fr->filename = st.filename;
+            fr->line = st.line;
+            fr->charpos = st.charpos;
+            result.push_back(fr);
+        }
 
-    // Insert 'rtkn' into tokenlist
-    tokenlist->insert(bt, rtkn);
-    tknindex = _tknindex+1;
-    
-    return token::EXPRESSION;
+        result.push_back(*it);
+    }
+
+    reverse(result.begin(), result.end());
+    stmts.swap(result);
+}
+
+/**
+ * Get the token to which errors should
+ * be attributed.
+ */
+token *Parser::errtkn() const {
+    if (executing)
+        return const_cast<token*>(&position);
+    else if (hasLast)
+        return const_cast<token*>(&last);
+    else if (fill(0))
+        return &lookahead.front();
+    else
+        return const_cast<token*>(&endtkn);
+}
+
+/**
+ * Make sure that at least 'ahead+1' tokens
+ * are available in the lookahead buffer, reading
+ * more from the lexer as needed. Returns 'false' if
+ * the end of the token stream is reached first.
+ *
+ * ahead: Number of tokens to skip.
+ */
+bool Parser::fill(unsigned long ahead) const {
+    token tkn;
+    while (lookahead.size() <= ahead) {
+        if (lexer == nullptr || !lexer->Next(tkn))
+            return false;
+
+        lookahead.push_back(tkn);
+    }
+
+    return true;
 }
 
 /**
  * Get the current token.
  */
 token *Parser::gtkn() const {
-    if (tknindex > 0 && tknindex <= tokenlist->size())
-        return tokenlist->at(tknindex-1);
+    if (hasLast)
+        return const_cast<token*>(&last);
     else
         Error("Internal error: Attempted to access token without active stream. Perhaps you forgot a final ';' or 'end'?");
     return nullptr;
@@ -368,12 +713,14 @@ bool Parser::is_number(const string& s) const {
 /**
  * Peek at the type of the next token
  * in the token list.
+ *
+ * ahead: Number of tokens to skip.
  */
-ttype Parser::peek() const {
-    if (tknindex >= tokenlist->size())
+ttype Parser::peek(unsigned long ahead) const {
+    if (!fill(ahead))
         return token::ENDOFSTREAM;
-    
-    return tokenlist->at(tknindex)->type;
+
+    return lookahead[ahead].type;
 }
 
 /**
@@ -0,0 +1,198 @@
+/**
+ * Implementation of the 'Scheduler' class.
+ */
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "interpreter/Scheduler.h"
+
+using namespace std;
+
+/**
+ * Constructor.
+ *
+ * stmts:    Statements to execute.
+ * run:      Function executing a single statement.
+ * out:      Stream to write the output of the statements to.
+ * nthreads: Number of threads to use (0 = one per core).
+ */
+Scheduler::Scheduler(const vector<StatementPtr> &stmts, task run, ostream &out, unsigned int nthreads)
+    : stmts(stmts), run(run), out(out) {
+    if (nthreads == 0)
+        nthreads = max(1u, thread::hardware_concurrency());
+
+    this->nthreads = nthreads;
+}
+
+/**
+ * Execute all statements, and return once they
+ * have finished. Rethrows the error of the first
+ * statement (in order) which failed.
+ */
+void Scheduler::Run() {
+    size_t n = stmts.size();
+
+    build();
+
+    outputs.assign(n, string());
+    errors.assign(n, nullptr);
+    done.assign(n, false);
+    committed = running = 0;
+    failed = n;
+
+    for (size_t i = 0; i < n; i++) {
+        if (npredecessors[i] == 0)
+            ready.push(i);
+    }
+
+    vector<thread> threads;
+    for (size_t i = 1; i < min((size_t)nthreads, n); i++)
+        threads.push_back(thread(&Scheduler::work, this));
+
+    work();
+
+    for (vector<thread>::iterator it = threads.begin(); it != threads.end(); it++)
+        it->join();
+
+    if (failed < n)
+        rethrow_exception(errors[failed]);
+}
+
+/**********************
+ * INTERNAL FUNCTIONS *
+ **********************/
+/**
+ * Build the dependency graph of the statements.
+ * Statements writing to files get an extra predecessor,
+ * which is removed when all statements before them have
+ * finished (see 'complete()').
+ */
+void Scheduler::build() {
+    size_t n = stmts.size();
+    // Last statement to define each label, and the statements
+    // which have used it since then
+    unordered_map<string, size_t> writer;
+    unordered_map<string, vector<size_t>> readers;
+
+    successors.assign(n, vector<size_t>());
+    npredecessors.assign(n, 0);
+
+    for (size_t i = 0; i < n; i++) {
+        vector<size_t> preds;
+        vector<string> inputs = stmts[i]->GetInputs();
+        vector<string> outputs = stmts[i]->GetOutputs();
+
+        for (vector<string>::iterator it = inputs.begin(); it != inputs.end(); it++) {
+            unordered_map<string, size_t>::iterator w = writer.find(*it);
+            if (w != writer.end())
+                preds.push_back(w->second);
+
+            readers[*it].push_back(i);
+        }
+
+        for (vector<string>::iterator it = outputs.begin(); it != outputs.end(); it++) {
+            unordered_map<string, size_t>::iterator w = writer.find(*it);
+            if (w != writer.end())
+                preds.push_back(w->second);
+
+            vector<size_t> &r = readers[*it];
+            preds.insert(preds.end(), r.begin(), r.end());
+            r.clear();
+
+            writer[*it] = i;
+        }
+
+        sort(preds.begin(), preds.end());
+        preds.erase(unique(preds.begin(), preds.end()), preds.end());
+
+        for (vector<size_t>::iterator it = preds.begin(); it != preds.end(); it++) {
+            // A statement may both use and redefine a label
+            if (*it == i)
+                continue;
+
+            successors[*it].push_back(i);
+            npredecessors[i]++;
+        }
+
+        if (stmts[i]->HasExternalEffects() && i > 0)
+            npredecessors[i]++;
+    }
+}
+
+/**
+ * Record that the given statement has finished,
+ * release the statements waiting for it, and write
+ * the output of all statements which have finished
+ * in order. Must be called with the lock held.
+ *
+ * i:      Index of the statement.
+ * output: Output of the statement.
+ * error:  Error thrown by the statement (if any).
+ */
+void Scheduler::complete(const size_t i, const string &output, exception_ptr error) {
+    size_t n = stmts.size();
+
+    done[i] = true;
+    if (error) {
+        errors[i] = error;
+        failed = min(failed, i);
+    } else {
+        outputs[i] = output;
+        for (vector<size_t>::iterator it = successors[i].begin(); it != successors[i].end(); it++) {
+            if (--npredecessors[*it] == 0)
+                ready.push(*it);
+        }
+    }
+
+    while (committed < n && done[committed] && !errors[committed]) {
+        out << outputs[committed];
+        string().swap(outputs[committed]);
+        committed++;
+
+        if (committed < n && stmts[committed]->HasExternalEffects() && --npredecessors[committed] == 0)
+            ready.push(committed);
+    }
+
+    out.flush();
+}
+
+/**
+ * Execute statements as they become ready, until
+ * there is nothing left to execute. Statements after
+ * a failed statement are not started.
+ */
+void Scheduler::work() {
+    unique_lock<mutex> l(lock);
+
+    for (;;) {
+        if (!ready.empty() && ready.top() < failed) {
+            size_t i = ready.top();
+            ready.pop();
+            running++;
+            l.unlock();
+
+            ostringstream os;
+            exception_ptr error;
+            try {
+                run(*stmts[i], os);
+            } catch (...) {
+                error = current_exception();
+            }
+
+            l.lock();
+            running--;
+            complete(i, os.str(), error);
+            cond.notify_all();
+        } else if (running == 0) {
+            // Everything else waits for statements
+            // which have failed (or there is nothing left)
+            cond.notify_all();
+            return;
+        } else
+            cond.wait(l);
+    }
+}
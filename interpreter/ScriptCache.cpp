@@ -0,0 +1,462 @@
+/**
+ * Implementation of the 'ScriptCache' class.
+ *
+ * The cache of the script 'file.sm' is stored in the file
+ * 'file.sm.smc'. It contains the parsed statements of the
+ * script, in which all parts of expressions that do not
+ * refer to labels have already been evaluated. All values
+ * are stored in native-endian byte order, with the layout
+ *
+ *   char   magic[8] = "SMCACHE3"
+ *   uint8  modular
+ *   uint32 nsources
+ *   nsources x { string name, uint64 size, uint64 hash }
+ *   uint64 nstatements
+ *   nstatements x statement
+ *
+ * where a string is { uint32 length, char text[length] }.
+ * The hash of a source file is the 64-bit FNV-1a hash of
+ * its contents. The cache is ignored if the contents of any
+ * of the source files have changed, or if it was written in
+ * another arithmetic mode (modular or not).
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <unistd.h>
+#include "symachin/Expression.h"
+#include "symachin/Factor.h"
+#include "symachin/Operators/Substitute.h"
+#include "symachin/SymachinException.h"
+#include "interpreter/ExpressionTree.h"
+#include "interpreter/ScriptCache.h"
+#include "interpreter/Statement.h"
+
+using namespace std;
+using namespace symachin;
+
+static const char SCRIPT_CACHE_MAGIC[8] = { 'S', 'M', 'C', 'A', 'C', 'H', 'E', '3' };
+
+/**
+ * Constructor.
+ *
+ * script: Name of script file to cache.
+ */
+ScriptCache::ScriptCache(const string &script) {
+    this->script = script;
+    this->cachefile = script + ".smc";
+}
+
+/**
+ * Compute the hash of the contents of the given file.
+ * Returns 'false' if the file could not be read.
+ *
+ * fname: Name of file to hash.
+ * size:  On return, contains the size of the file.
+ * hash:  On return, contains the hash of the file.
+ */
+bool ScriptCache::HashFile(const string &fname, uint64_t *size, uint64_t *hash) {
+    ifstream f(fname, ios::binary);
+    if (!f.is_open())
+        return false;
+
+    // 64-bit FNV-1a
+    uint64_t h = 0xCBF29CE484222325ULL, n = 0;
+    vector<char> buffer(1 << 20);
+    while (f) {
+        f.read(buffer.data(), buffer.size());
+        streamsize len = f.gcount();
+        for (streamsize i = 0; i < len; i++) {
+            h ^= (unsigned char)buffer[i];
+            h *= 0x100000001B3ULL;
+        }
+
+        n += len;
+    }
+
+    if (f.bad())
+        return false;
+
+    *size = n;
+    *hash = h;
+    return true;
+}
+
+/**
+ * Load the cached statements of the script. Returns
+ * 'false' if there is no cache, or if it is outdated or
+ * invalid, in which case the script must be parsed.
+ *
+ * statements: List to append the statements to.
+ * filenames:  Set in which to intern the names of
+ *             the source files of the statements.
+ */
+bool ScriptCache::Load(vector<StatementPtr> &statements, unordered_set<string> &filenames) {
+    in.open(cachefile, ios::binary | ios::ate);
+    if (!in.is_open())
+        return false;
+
+    left = in.tellg();
+    in.seekg(0);
+
+    vector<StatementPtr> stmts;
+    try {
+        char magic[sizeof(SCRIPT_CACHE_MAGIC)];
+        read(magic, sizeof(magic));
+        if (!equal(magic, magic+sizeof(magic), SCRIPT_CACHE_MAGIC))
+            return false;
+
+        if ((read<uint8_t>() != 0) != Factor::IsModularArithmetic())
+            return false;
+
+        // Check that the sources are unchanged
+        uint32_t nsources = read<uint32_t>();
+        for (uint32_t i = 0; i < nsources; i++) {
+            string name = read_string();
+            uint64_t size = read<uint64_t>(), hash = read<uint64_t>(), s, h;
+
+            if (!HashFile(name, &s, &h) || s != size || h != hash)
+                return false;
+
+            sources.push_back(&(*filenames.insert(name).first));
+        }
+
+        uint64_t n = read<uint64_t>();
+        if (n > left)
+            return false;
+
+        stmts.reserve(n);
+        for (uint64_t i = 0; i < n; i++)
+            stmts.push_back(read_statement());
+
+        if (left != 0)
+            return false;
+    } catch (SymachinException &ex) {
+        return false;
+    }
+
+    statements.insert(statements.end(), stmts.begin(), stmts.end());
+    return true;
+}
+
+/**
+ * Write the given statements to the cache. If the cache
+ * cannot be written, an exception is thrown.
+ *
+ * files:      Source files from which the statements
+ *             were read.
+ * statements: Statements to store.
+ */
+void ScriptCache::Save(const vector<string> &files, const vector<StatementPtr> &statements) {
+    string tmpfile = cachefile + ".tmp" + to_string(getpid());
+    out.open(tmpfile, ios::binary);
+    if (!out.is_open())
+        throw SymachinException("Unable to open file for writing: %s.", tmpfile.c_str());
+
+    try {
+        write(SCRIPT_CACHE_MAGIC, sizeof(SCRIPT_CACHE_MAGIC));
+        write<uint8_t>(Factor::IsModularArithmetic() ? 1 : 0);
+
+        write<uint32_t>(files.size());
+        for (vector<string>::const_iterator it = files.begin(); it != files.end(); it++) {
+            uint64_t size, hash;
+            if (!HashFile(*it, &size, &hash))
+                throw SymachinException("Unable to read file: %s.", it->c_str());
+
+            sourceIndex.insert({*it, sourceIndex.size()});
+            write_string(*it);
+            write<uint64_t>(size);
+            write<uint64_t>(hash);
+        }
+
+        write<uint64_t>(statements.size());
+        for (vector<StatementPtr>::const_iterator it = statements.begin(); it != statements.end(); it++)
+            write_statement(**it);
+
+        out.close();
+        if (!out)
+            throw SymachinException("Unable to write file: %s.", tmpfile.c_str());
+
+        if (rename(tmpfile.c_str(), cachefile.c_str()) != 0)
+            throw SymachinException("Unable to write file: %s.", cachefile.c_str());
+    } catch (SymachinException &ex) {
+        out.close();
+        remove(tmpfile.c_str());
+        throw;
+    }
+}
+
+/**********************
+ * READING
+ **********************/
+/**
+ * Read 'n' bytes from the cache.
+ */
+void ScriptCache::read(void *data, size_t n) {
+    if (n > left)
+        throw SymachinException("%s: Unexpected end of file.", cachefile.c_str());
+
+    in.read((char*)data, n);
+    if (!in)
+        throw SymachinException("%s: Unable to read file.", cachefile.c_str());
+
+    left -= n;
+}
+
+/**
+ * Read an expression (list of terms) from the cache.
+ */
+ExpressionPtr ScriptCache::read_expression() {
+    uint64_t nterms = read<uint64_t>();
+    if (nterms > left)
+        throw SymachinException("%s: Invalid expression.", cachefile.c_str());
+
+    vectorTermPtr terms(new vector<TermPtr>());
+    terms->reserve(nterms);
+    for (uint64_t i = 0; i < nterms; i++) {
+        uint32_t nfactors = read<uint32_t>();
+        if (nfactors == 0 || nfactors > left)
+            throw SymachinException("%s: Invalid term.", cachefile.c_str());
+
+        vectorFactorPtr factors(new vector<FactorPtr>());
+        factors->reserve(nfactors);
+        for (uint32_t j = 0; j < nfactors; j++) {
+            string name = read_string();
+            enum sign s = (read<uint8_t>() ? SYMACHIN_SIGN_NEG : SYMACHIN_SIGN_POS);
+            factors->push_back(Factor::Intern(Factor(name, s)));
+        }
+
+        terms->push_back(TermPtr(new Term(factors)));
+    }
+
+    return ExpressionPtr(new Expression(terms));
+}
+
+/**
+ * Read a statement from the cache.
+ */
+StatementPtr ScriptCache::read_statement() {
+    uint8_t type = read<uint8_t>();
+    if (type > Statement::SUBSTITUTE)
+        throw SymachinException("%s: Invalid statement.", cachefile.c_str());
+
+    StatementPtr st(new Statement((Statement::statement_type)type, read_string()));
+
+    uint32_t source = read<uint32_t>();
+    if (source >= sources.size())
+        throw SymachinException("%s: Invalid statement.", cachefile.c_str());
+
+    st->filename = sources[source];
+    st->line = read<int64_t>();
+    st->charpos = read<int64_t>();
+
+    uint32_t n = read<uint32_t>();
+    for (uint32_t i = 0; i < n; i++)
+        st->expressions.push_back(read_tree());
+
+    n = read<uint32_t>();
+    for (uint32_t i = 0; i < n; i++)
+        st->names.push_back(read_string());
+
+    n = read<uint32_t>();
+    for (uint32_t i = 0; i < n; i++) {
+        string sym = read_string();
+        st->values[sym] = read<double>();
+    }
+
+    st->otherValue = read<double>();
+    st->expected = read<double>();
+
+    n = read<uint32_t>();
+    for (uint32_t i = 0; i < n; i++)
+        st->wrt.push_back(read_string());
+
+    st->input = read_string();
+    st->output = read_string();
+    st->otherLabel = read_string();
+
+    if (read<uint8_t>()) {
+        st->substitute = SubstitutePtr(new Substitute());
+
+        n = read<uint32_t>();
+        for (uint32_t i = 0; i < n; i++) {
+            string sym = read_string();
+            long long num = read<int64_t>(), den = read<int64_t>();
+            st->substitute->SetValue(sym, num, den);
+        }
+    }
+
+    return st;
+}
+
+/**
+ * Read a string from the cache.
+ */
+string ScriptCache::read_string() {
+    uint32_t len = read<uint32_t>();
+    if (len > left)
+        throw SymachinException("%s: Unexpected end of file.", cachefile.c_str());
+
+    string s(len, '\0');
+    read(&s[0], len);
+
+    return s;
+}
+
+/**
+ * Read an expression tree from the cache.
+ */
+ExpressionTreePtr ScriptCache::read_tree() {
+    uint8_t type = read<uint8_t>();
+    vector<ExpressionTreePtr> operands;
+    vector<bool> negated;
+    uint32_t n;
+
+    switch (type) {
+        case ExpressionTree::CONSTANT:
+            return ExpressionTreePtr(new ExpressionTree(read_expression()));
+        case ExpressionTree::REFERENCE:
+        case ExpressionTree::SYMBOL:
+            return ExpressionTreePtr(new ExpressionTree((ExpressionTree::node_type)type, read_string()));
+        case ExpressionTree::PRODUCT:
+        case ExpressionTree::SUM:
+            n = read<uint32_t>();
+            if (n == 0)
+                throw SymachinException("%s: Invalid expression.", cachefile.c_str());
+
+            for (uint32_t i = 0; i < n; i++) {
+                if (type == ExpressionTree::SUM)
+                    negated.push_back(read<uint8_t>() != 0);
+
+                operands.push_back(read_tree());
+            }
+
+            return ExpressionTreePtr(new ExpressionTree((ExpressionTree::node_type)type, operands, negated));
+        default:
+            throw SymachinException("%s: Invalid expression.", cachefile.c_str());
+    }
+}
+
+/**********************
+ * WRITING
+ **********************/
+/**
+ * Write 'n' bytes to the cache.
+ */
+void ScriptCache::write(const void *data, size_t n) {
+    out.write((const char*)data, n);
+}
+
+/**
+ * Write an expression (list of terms) to the cache.
+ */
+void ScriptCache::write_expression(const Expression &expr) {
+    vectorTermPtr terms = expr.GetTerms();
+
+    write<uint64_t>(terms->size());
+    for (vector<TermPtr>::const_iterator it = terms->begin(); it != terms->end(); it++) {
+        vectorFactorPtr factors = (*it)->GetFactors();
+
+        write<uint32_t>(factors->size());
+        for (vector<FactorPtr>::const_iterator jt = factors->begin(); jt != factors->end(); jt++) {
+            write_string((*jt)->GetName());
+            write<uint8_t>((*jt)->GetSign() == SYMACHIN_SIGN_NEG ? 1 : 0);
+        }
+    }
+}
+
+/**
+ * Write a statement to the cache.
+ */
+void ScriptCache::write_statement(const Statement &st) {
+    unordered_map<string, uint32_t>::const_iterator src;
+    if (st.filename == nullptr || (src=sourceIndex.find(*st.filename)) == sourceIndex.end())
+        throw SymachinException("Statement does not belong to any of the source files.");
+
+    write<uint8_t>(st.type);
+    write_string(st.label);
+    write<uint32_t>(src->second);
+    write<int64_t>(st.line);
+    write<int64_t>(st.charpos);
+
+    write<uint32_t>(st.expressions.size());
+    for (vector<ExpressionTreePtr>::const_iterator it = st.expressions.begin(); it != st.expressions.end(); it++)
+        write_tree(*it);
+
+    write<uint32_t>(st.names.size());
+    for (vector<string>::const_iterator it = st.names.begin(); it != st.names.end(); it++)
+        write_string(*it);
+
+    write<uint32_t>(st.values.size());
+    for (map<string, double>::const_iterator it = st.values.begin(); it != st.values.end(); it++) {
+        write_string(it->first);
+        write<double>(it->second);
+    }
+
+    write<double>(st.otherValue);
+    write<double>(st.expected);
+
+    write<uint32_t>(st.wrt.size());
+    for (vector<string>::const_iterator it = st.wrt.begin(); it != st.wrt.end(); it++)
+        write_string(*it);
+
+    write_string(st.input);
+    write_string(st.output);
+    write_string(st.otherLabel);
+
+    write<uint8_t>(st.substitute != nullptr ? 1 : 0);
+    if (st.substitute != nullptr) {
+        const map<string, pair<long long, long long>> &values = st.substitute->GetValues();
+
+        write<uint32_t>(values.size());
+        for (map<string, pair<long long, long long>>::const_iterator it = values.begin(); it != values.end(); it++) {
+            write_string(it->first);
+            write<int64_t>(it->second.first);
+            write<int64_t>(it->second.second);
+        }
+    }
+}
+
+/**
+ * Write a string to the cache.
+ */
+void ScriptCache::write_string(const string &s) {
+    write<uint32_t>(s.length());
+    write(s.data(), s.length());
+}
+
+/**
+ * Write an expression tree to the cache.
+ */
+void ScriptCache::write_tree(const ExpressionTreePtr &tree) {
+    write<uint8_t>(tree->GetType());
+
+    switch (tree->GetType()) {
+        case ExpressionTree::CONSTANT:
+            write_expression(*tree->GetExpression());
+            break;
+        case ExpressionTree::REFERENCE:
+        case ExpressionTree::SYMBOL:
+            write_string(tree->GetText());
+            break;
+        case ExpressionTree::PRODUCT:
+        case ExpressionTree::SUM: {
+            const vector<ExpressionTreePtr> &operands = tree->GetOperands();
+
+            write<uint32_t>(operands.size());
+            for (size_t i = 0; i < operands.size(); i++) {
+                if (tree->GetType() == ExpressionTree::SUM)
+                    write<uint8_t>(tree->GetNegated()[i] ? 1 : 0);
+
+                write_tree(operands[i]);
+            }
+            break;
+        }
+    }
+}
@@ -0,0 +1,86 @@
+/**
+ * Implementation of the 'Statement' class.
+ */
+
+#include <string>
+#include <vector>
+#include "interpreter/ExpressionTree.h"
+#include "interpreter/Statement.h"
+
+using namespace std;
+
+/**
+ * Returns the names of the labels and rules which
+ * are used by this statement.
+ */
+vector<string> Statement::GetInputs() const {
+    vector<string> inputs;
+
+    for (vector<ExpressionTreePtr>::const_iterator it = expressions.begin(); it != expressions.end(); it++)
+        (*it)->GetReferences(inputs);
+
+    switch (type) {
+        case APPLY:
+            inputs.push_back(names.front());
+            break;
+        case EXPORT:
+            inputs.insert(inputs.end(), names.begin(), names.end());
+            break;
+        default: break;
+    }
+
+    return inputs;
+}
+
+/**
+ * Returns the names of the labels and rules which
+ * are (re)defined or freed by this statement.
+ */
+vector<string> Statement::GetOutputs() const {
+    vector<string> outputs;
+
+    switch (type) {
+        case APPLY:
+        case ASSIGN:
+        case DEFINE:
+        case REPLACE:
+        case SUBSTITUTE:
+            outputs.push_back(label);
+            break;
+        case FREE:
+        case GROUP:
+            outputs = names;
+            if (!otherLabel.empty())
+                outputs.push_back(otherLabel);
+            break;
+        default: break;
+    }
+
+    return outputs;
+}
+
+/**
+ * Returns 'true' if this statement assigns the result
+ * of an operation on a label to that same label, as in
+ * '[A] apply R to $A;'.
+ */
+bool Statement::IsUpdate() const {
+    ExpressionTreePtr operand;
+
+    switch (type) {
+        case APPLY: operand = expressions[0]; break;
+        case REPLACE: operand = expressions[1]; break;
+        default: return false;
+    }
+
+    return (operand->GetType() == ExpressionTree::REFERENCE && operand->GetText() == label);
+}
+
+/**
+ * Returns 'true' if this statement has effects outside
+ * of the interpreter other than printing, i.e. if it
+ * writes to a file.
+ */
+bool Statement::HasExternalEffects() const {
+    return (type == EVAL_TABLE || (type == EXPORT && !output.empty()));
+}
@@ -0,0 +1,229 @@
+/**
+ * Implementation of the 'Table' class.
+ *
+ * Tables are read from and written to either CSV files
+ * (recognized by the extension '.csv') or binary files.
+ * A CSV file contains a header line with the column names,
+ * followed by one line of comma-separated values per row.
+ * Empty lines and lines starting with '#' are ignored.
+ *
+ * A binary file has the (native-endian) layout
+ *
+ *   uint32 ncols
+ *   ncols x { uint32 length, char name[length] }
+ *   uint64 nrows
+ *   double values[nrows][ncols]
+ */
+
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "interpreter/Table.h"
+#include "symachin/SymachinException.h"
+
+using namespace std;
+
+/**
+ * Constructor.
+ *
+ * nrows:  Number of rows of the table.
+ * binary: If true, the table is written in binary format
+ *         (and otherwise as CSV).
+ */
+Table::Table(const size_t nrows, bool binary) {
+    this->nrows = nrows;
+    this->binary = binary;
+}
+
+/**
+ * Add a column with the given name to the table.
+ * Returns a reference to the (zero-initialized) column.
+ */
+vector<double>& Table::AddColumn(const string &name) {
+    names.push_back(name);
+    columns.push_back(vector<double>(nrows, 0.0));
+
+    return columns.back();
+}
+
+/**
+ * Returns the column with the given name, or 'nullptr'
+ * if there is no such column.
+ */
+const vector<double> *Table::GetColumn(const string &name) const {
+    for (unsigned int i = 0; i < names.size(); i++) {
+        if (names[i] == name)
+            return &columns[i];
+    }
+
+    return nullptr;
+}
+
+/**
+ * Check whether the given file name refers to a CSV file.
+ */
+bool Table::IsCSVFile(const string &fname) {
+    return (fname.length() >= 4 && fname.compare(fname.length()-4, 4, ".csv") == 0);
+}
+
+/**
+ * Read the table from the given file.
+ */
+void Table::Read(const string &fname) {
+    names.clear();
+    columns.clear();
+    nrows = 0;
+
+    binary = !IsCSVFile(fname);
+    if (binary)
+        read_binary(fname);
+    else
+        read_csv(fname);
+}
+
+/**
+ * Write the table to the given file.
+ */
+void Table::Write(const string &fname) const {
+    if (binary)
+        write_binary(fname);
+    else
+        write_csv(fname);
+}
+
+/**
+ * Read a table in binary format.
+ */
+void Table::read_binary(const string &fname) {
+    ifstream f(fname, ios::binary);
+    if (!f.is_open())
+        throw SymachinException("Unable to open file: %s.", fname.c_str());
+
+    uint32_t ncols, len;
+    uint64_t n;
+
+    f.read((char*)&ncols, sizeof(ncols));
+    for (uint32_t i = 0; f && i < ncols; i++) {
+        f.read((char*)&len, sizeof(len));
+        string name(len, '\0');
+        f.read(&name[0], len);
+        names.push_back(name);
+    }
+    f.read((char*)&n, sizeof(n));
+
+    if (!f)
+        throw SymachinException("%s: Invalid table header.", fname.c_str());
+
+    nrows = n;
+    columns.resize(ncols, vector<double>(nrows));
+
+    vector<double> row(ncols);
+    for (size_t i = 0; i < nrows; i++) {
+        f.read((char*)row.data(), ncols*sizeof(double));
+        if (!f)
+            throw SymachinException("%s: Unexpected end of file on row %zu.", fname.c_str(), i+1);
+
+        for (uint32_t j = 0; j < ncols; j++)
+            columns[j][i] = row[j];
+    }
+}
+
+/**
+ * Read a table in CSV format.
+ */
+void Table::read_csv(const string &fname) {
+    ifstream f(fname);
+    if (!f.is_open())
+        throw SymachinException("Unable to open file: %s.", fname.c_str());
+
+    string line, cell;
+    long lineno = 0;
+    bool header = true;
+    while (getline(f, line)) {
+        lineno++;
+
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == string::npos || line[first] == '#')
+            continue;
+
+        stringstream ss(line);
+        unsigned int i = 0;
+        while (getline(ss, cell, ',')) {
+            size_t b = cell.find_first_not_of(" \t\r"),
+                   e = cell.find_last_not_of(" \t\r");
+            cell = (b == string::npos ? "" : cell.substr(b, e-b+1));
+
+            if (header) {
+                names.push_back(cell);
+                columns.push_back(vector<double>());
+            } else if (i >= names.size())
+                throw SymachinException("%s: line %ld: Too many values.", fname.c_str(), lineno);
+            else {
+                try {
+                    columns[i].push_back(stod(cell));
+                } catch (exception&) {
+                    throw SymachinException("%s: line %ld: Invalid number: '%s'.", fname.c_str(), lineno, cell.c_str());
+                }
+            }
+
+            i++;
+        }
+
+        if (header)
+            header = false;
+        else if (i != names.size())
+            throw SymachinException("%s: line %ld: Too few values.", fname.c_str(), lineno);
+        else
+            nrows++;
+    }
+}
+
+/**
+ * Write the table in binary format.
+ */
+void Table::write_binary(const string &fname) const {
+    ofstream f(fname, ios::binary);
+    if (!f.is_open())
+        throw SymachinException("Unable to open file for writing: %s.", fname.c_str());
+
+    uint32_t ncols = names.size();
+    uint64_t n = nrows;
+
+    f.write((const char*)&ncols, sizeof(ncols));
+    for (uint32_t j = 0; j < ncols; j++) {
+        uint32_t len = names[j].length();
+        f.write((const char*)&len, sizeof(len));
+        f.write(names[j].data(), len);
+    }
+    f.write((const char*)&n, sizeof(n));
+
+    vector<double> row(ncols);
+    for (size_t i = 0; i < nrows; i++) {
+        for (uint32_t j = 0; j < ncols; j++)
+            row[j] = columns[j][i];
+
+        f.write((const char*)row.data(), ncols*sizeof(double));
+    }
+}
+
+/**
+ * Write the table in CSV format.
+ */
+void Table::write_csv(const string &fname) const {
+    ofstream f(fname);
+    if (!f.is_open())
+        throw SymachinException("Unable to open file for writing: %s.", fname.c_str());
+
+    f.precision(17);
+    for (unsigned int j = 0; j < names.size(); j++)
+        f << (j > 0 ? "," : "") << names[j];
+    f << endl;
+
+    for (size_t i = 0; i < nrows; i++) {
+        for (unsigned int j = 0; j < names.size(); j++)
+            f << (j > 0 ? "," : "") << columns[j][i];
+        f << "\n";
+    }
+}
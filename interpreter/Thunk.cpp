@@ -0,0 +1,36 @@
+/**
+ * Implementation of the 'Thunk' class.
+ */
+
+#include <vector>
+#include "interpreter/Thunk.h"
+
+using namespace std;
+
+/**
+ * Destructor. A thunk which has not been evaluated holds
+ * on to the thunks of its inputs, which may form a chain
+ * as long as the script (e.g. a label updated by every
+ * statement). The chain is released iteratively, since
+ * releasing it recursively would overflow the stack.
+ */
+Thunk::~Thunk() {
+    vector<ThunkPtr> pending;
+
+    for (ThunkMap::iterator it = inputs.begin(); it != inputs.end(); it++)
+        pending.push_back(it->second);
+    inputs.clear();
+
+    while (!pending.empty()) {
+        ThunkPtr t = pending.back();
+        pending.pop_back();
+
+        // Only take over the inputs of thunks which are
+        // released along with this one
+        if (t.use_count() == 1) {
+            for (ThunkMap::iterator it = t->inputs.begin(); it != t->inputs.end(); it++)
+                pending.push_back(it->second);
+            t->inputs.clear();
+        }
+    }
+}
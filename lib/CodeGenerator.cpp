@@ -0,0 +1,342 @@
+/**
+ * Implementation of the 'CodeGenerator' class.
+ *
+ * The code generator emits a self-contained C function
+ * (which is also valid C++) evaluating one or more
+ * expressions numerically. The symbols of the expressions
+ * become the arguments of the function. Short expressions
+ * are written out as straight-line code in Horner form
+ * (see 'HornerPlanner'), while long sums are evaluated in
+ * loops over static tables of coefficients and indices
+ * into a table of (hoisted) powers of the symbols.
+ */
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "symachin/CodeGenerator.h"
+#include "symachin/CompiledExpression.h"
+#include "symachin/HornerPlanner.h"
+
+using namespace std;
+using namespace symachin;
+
+const unsigned int CodeGenerator::TABLE_THRESHOLD;
+
+/**
+ * Constructor.
+ *
+ * funcname: Name of the function to generate.
+ */
+CodeGenerator::CodeGenerator(const string &funcname) {
+    map<string, unsigned int> used;
+    this->funcname = cname(funcname, used);
+}
+
+/**
+ * Add an expression to evaluate in the generated function.
+ *
+ * name: Name of the expression (used in comments).
+ * expr: Expression to evaluate.
+ */
+void CodeGenerator::Add(const string &name, const Expression &expr) {
+    output o;
+    o.name = name;
+    CompiledExpression::Decompose(expr, symbols, slots, o.coefficients, o.monomials);
+
+    outputs.push_back(o);
+}
+
+/**
+ * Turn the given name into a valid C identifier which
+ * has not been used before and does not clash with the
+ * identifiers used internally by the generated code
+ * (which all start with 'sm_'). Keywords of C (up to C23)
+ * and C++, alternative operator names, and the names
+ * defined by the headers the code includes (or which are
+ * macros in some C standard, such as 'bool' and 'true')
+ * get a trailing '_'. Since names containing '__', or
+ * starting with '_', are reserved, runs of underscores are
+ * collapsed and a leading '_' gets an 'x' prefix.
+ *
+ * name: Name to convert.
+ * used: Identifiers used so far (and the number of times).
+ */
+string CodeGenerator::cname(const string &name, map<string, unsigned int> &used) const {
+    static const set<string> keywords = {
+        // C (up to C23; the keywords starting with '_', such
+        // as '_Bool', never match since such names are prefixed)
+        "alignas", "alignof", "auto", "bool", "break", "case", "char", "const",
+        "constexpr", "continue", "default", "do", "double", "else", "enum",
+        "extern", "false", "float", "for", "goto", "if", "inline", "int",
+        "long", "nullptr", "register", "restrict", "return", "short", "signed",
+        "sizeof", "static", "static_assert", "struct", "switch",
+        "thread_local", "true", "typedef", "typeof", "typeof_unqual", "union",
+        "unsigned", "void", "volatile", "while",
+        // C++
+        "asm", "catch", "char16_t", "char32_t", "char8_t", "class", "co_await",
+        "co_return", "co_yield", "concept", "const_cast", "consteval",
+        "constinit", "decltype", "delete", "dynamic_cast", "explicit", "export",
+        "friend", "mutable", "namespace", "new", "noexcept", "operator",
+        "private", "protected", "public", "reinterpret_cast", "requires",
+        "static_cast", "template", "this", "throw", "try", "typeid",
+        "typename", "using", "virtual", "wchar_t",
+        // Alternative operator names (C++, and <iso646.h>)
+        "and", "and_eq", "bitand", "bitor", "compl", "not", "not_eq", "or",
+        "or_eq", "xor", "xor_eq",
+        // Names defined by <stddef.h> (and <stdbool.h>)
+        "NULL", "max_align_t", "nullptr_t", "offsetof", "ptrdiff_t", "size_t",
+        "unreachable"
+    };
+
+    string s;
+    for (string::const_iterator it = name.begin(); it != name.end(); it++) {
+        char c = *it;
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_')
+            s += c;
+        else
+            s += '_';
+    }
+
+    // Collapse runs of underscores
+    for (size_t i = s.find("__"); i != string::npos; i = s.find("__", i))
+        s.erase(i, 1);
+
+    if (!s.empty() && s[0] == '_')
+        s = "x" + s;
+    else if (s.empty() || (s[0] >= '0' && s[0] <= '9') || s.compare(0, 3, "sm_") == 0)
+        s = "x_" + s;
+    if (keywords.count(s) > 0)
+        s += '_';
+
+    unsigned int n = used[s]++;
+    if (n > 0) {
+        s += (s[s.length()-1] == '_' ? "" : "_") + to_string(n+1);
+        used[s]++;
+    }
+
+    return s;
+}
+
+/**
+ * Assign C names to all symbols.
+ */
+void CodeGenerator::assign_cnames() {
+    map<string, unsigned int> used;
+    cnames.clear();
+    for (vector<string>::const_iterator it = symbols.begin(); it != symbols.end(); it++)
+        cnames.push_back(cname(*it, used));
+}
+
+/**
+ * Generate the C code.
+ */
+string CodeGenerator::Generate() {
+    ostringstream os;
+    os.precision(17);
+
+    assign_cnames();
+
+    // Highest power of each symbol in the tabulated sums
+    vector<unsigned int> maxPower(symbols.size(), 0), powerOffset(symbols.size(), 0);
+    unsigned int npowers = 0;
+    for (vector<output>::const_iterator it = outputs.begin(); it != outputs.end(); it++) {
+        if (it->coefficients.size() <= TABLE_THRESHOLD)
+            continue;
+
+        for (vector<monomial>::const_iterator jt = it->monomials.begin(); jt != it->monomials.end(); jt++) {
+            for (monomial::const_iterator kt = jt->begin(); kt != jt->end(); kt++)
+                maxPower[kt->first] = max(maxPower[kt->first], kt->second);
+        }
+    }
+    for (unsigned int s = 0; s < symbols.size(); s++) {
+        powerOffset[s] = npowers;
+        npowers += maxPower[s];
+    }
+
+    // Header
+    os << "/**" << endl
+       << " * Generated by symachin." << endl
+       << " *" << endl;
+    if (outputs.size() == 1)
+        os << " * Returns the value of '" << outputs[0].name << "'." << endl;
+    else {
+        os << " * Stores the values of the following expressions in 'sm_out':" << endl;
+        for (unsigned int i = 0; i < outputs.size(); i++)
+            os << " *   sm_out[" << i << "] = " << outputs[i].name << endl;
+    }
+    for (unsigned int s = 0; s < symbols.size(); s++) {
+        if (cnames[s] != symbols[s])
+            os << " * Argument '" << cnames[s] << "' is the symbol '" << symbols[s] << "'." << endl;
+    }
+    os << " */" << endl
+       << "#include <stddef.h>" << endl
+       << endl;
+
+    os << (outputs.size() == 1 ? "double " : "void ") << funcname << "(";
+    for (unsigned int s = 0; s < symbols.size(); s++)
+        os << (s > 0 ? ", " : "") << "const double " << cnames[s];
+    if (outputs.size() != 1)
+        os << (symbols.size() > 0 ? ", " : "") << "double *sm_out";
+    else if (symbols.size() == 0)
+        os << "void";
+    os << ") {" << endl;
+
+    // Hoisted powers
+    if (npowers > 0) {
+        os << "    double sm_pw[" << npowers << "];" << endl;
+        for (unsigned int s = 0; s < symbols.size(); s++) {
+            for (unsigned int k = 0; k < maxPower[s]; k++) {
+                os << "    sm_pw[" << (powerOffset[s]+k) << "] = ";
+                if (k == 0)
+                    os << cnames[s] << ";" << endl;
+                else
+                    os << "sm_pw[" << (powerOffset[s]+k-1) << "] * " << cnames[s] << ";" << endl;
+            }
+        }
+        os << endl;
+    }
+
+    for (unsigned int i = 0; i < outputs.size(); i++) {
+        string res = "sm_r" + to_string(i);
+
+        os << "    /* " << outputs[i].name << " */" << endl;
+        if (outputs[i].coefficients.size() > TABLE_THRESHOLD)
+            generate_table(os, outputs[i], i, res, powerOffset);
+        else
+            generate_straight(os, outputs[i], res);
+        os << endl;
+    }
+
+    if (outputs.size() == 1)
+        os << "    return sm_r0;" << endl;
+    else {
+        for (unsigned int i = 0; i < outputs.size(); i++)
+            os << "    sm_out[" << i << "] = sm_r" << i << ";" << endl;
+    }
+    os << "}" << endl;
+
+    return os.str();
+}
+
+/**
+ * Generate straight-line code evaluating the given
+ * output in Horner form.
+ *
+ * os:  Stream to write code to.
+ * o:   Output to generate code for.
+ * res: Name of variable to store the result in.
+ */
+void CodeGenerator::generate_straight(ostringstream &os, const output &o, const string &res) const {
+    HornerPlanner planner(symbols.size());
+    vector<eval_op> ops;
+    unsigned int outputreg;
+    unsigned int nregs = planner.Plan(o.coefficients, o.monomials, ops, &outputreg);
+
+    // Current name of the value held by each register
+    vector<string> reg(nregs);
+
+    os << "    double " << res << ";" << endl
+       << "    {" << endl;
+
+    for (unsigned int i = 0; i < ops.size(); i++) {
+        const eval_op &op = ops[i];
+        ostringstream val;
+        val.precision(17);
+
+        switch (op.type) {
+            case eval_op::LOAD:
+                reg[op.dest] = cnames[op.a];
+                continue;
+            case eval_op::CONST:
+                val << "(" << op.value << ")";
+                reg[op.dest] = val.str();
+                continue;
+            case eval_op::ADD:    val << reg[op.a] << " + " << reg[op.b]; break;
+            case eval_op::MUL:    val << reg[op.a] << " * " << reg[op.b]; break;
+            case eval_op::MULADD: val << reg[op.a] << " * " << reg[op.b] << " + " << reg[op.c]; break;
+            case eval_op::SCALE:  val << "(" << op.value << ") * " << reg[op.a]; break;
+        }
+
+        string t = "sm_t" + to_string(i);
+        os << "        const double " << t << " = " << val.str() << ";" << endl;
+        reg[op.dest] = t;
+    }
+
+    os << "        " << res << " = " << reg[outputreg] << ";" << endl
+       << "    }" << endl;
+}
+
+/**
+ * Generate code evaluating the given output in loops over
+ * tables of coefficients. Terms are grouped by the number
+ * of symbols they contain, and every group is evaluated in
+ * a separate loop.
+ *
+ * os:          Stream to write code to.
+ * o:           Output to generate code for.
+ * idx:         Index of output (used in names of tables).
+ * res:         Name of variable to store the result in.
+ * powerOffset: Index in 'sm_pw' of the first power of each symbol.
+ */
+void CodeGenerator::generate_table(
+    ostringstream &os, const output &o, unsigned int idx,
+    const string &res, const vector<unsigned int> &powerOffset
+) const {
+    map<unsigned int, vector<unsigned int>> groups;
+    unsigned int maxIndex = 0;
+    for (unsigned int i = 0; i < o.monomials.size(); i++) {
+        const monomial &m = o.monomials[i];
+        groups[m.size()].push_back(i);
+
+        for (monomial::const_iterator jt = m.begin(); jt != m.end(); jt++)
+            maxIndex = max(maxIndex, powerOffset[jt->first] + jt->second - 1);
+    }
+
+    const string itype = (maxIndex < 65536 ? "unsigned short" : "unsigned int");
+
+    os << "    double " << res << " = 0.0;" << endl;
+    for (map<unsigned int, vector<unsigned int>>::const_iterator it = groups.begin(); it != groups.end(); it++) {
+        const unsigned int d = it->first;
+        const vector<unsigned int> &terms = it->second;
+        const string suffix = to_string(idx) + "_" + to_string(d);
+
+        os << "    {" << endl;
+
+        // Coefficients
+        os << "        static const double sm_c" << suffix << "[" << terms.size() << "] = {";
+        for (unsigned int i = 0; i < terms.size(); i++) {
+            os << (i % 4 == 0 ? "\n            " : " ") << o.coefficients[terms[i]] << ",";
+        }
+        os << endl << "        };" << endl;
+
+        if (d == 0) {
+            os << "        " << res << " += sm_c" << suffix << "[0];" << endl
+               << "    }" << endl;
+            continue;
+        }
+
+        // Indices into 'sm_pw'
+        os << "        static const " << itype << " sm_m" << suffix << "[" << terms.size()*d << "] = {";
+        for (unsigned int i = 0; i < terms.size(); i++) {
+            const monomial &m = o.monomials[terms[i]];
+            os << "\n           ";
+            for (monomial::const_iterator jt = m.begin(); jt != m.end(); jt++)
+                os << " " << (powerOffset[jt->first] + jt->second - 1) << ",";
+        }
+        os << endl << "        };" << endl;
+
+        os << "        for (size_t sm_i = 0; sm_i < " << terms.size() << "; sm_i++) {" << endl
+           << "            const " << itype << " *sm_m = sm_m" << suffix << " + " << d << "*sm_i;" << endl
+           << "            " << res << " += sm_c" << suffix << "[sm_i]";
+        for (unsigned int k = 0; k < d; k++)
+            os << " * sm_pw[sm_m[" << k << "]]";
+        os << ";" << endl
+           << "        }" << endl
+           << "    }" << endl;
+    }
+}
@@ -0,0 +1,512 @@
+/**
+ * Implementation of the 'CompiledExpression' class.
+ *
+ * A compiled expression is a representation of an expression
+ * suitable for fast repeated numerical evaluation. Every
+ * symbol is bound to a slot in an array of values, and the
+ * expression is turned into a short program of arithmetic
+ * operations on a set of registers (see 'HornerPlanner').
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "symachin/CompiledExpression.h"
+#include "symachin/Expression.h"
+#include "symachin/HornerPlanner.h"
+
+using namespace std;
+using namespace symachin;
+
+const unsigned int CompiledExpression::NO_SLOT;
+const unsigned int CompiledExpression::BLOCK_SIZE;
+
+/**
+ * Constructor. Compile the given expression.
+ */
+CompiledExpression::CompiledExpression(const Expression &expr) {
+    vector<double> coefficients;
+    vector<monomial> monomials;
+
+    Decompose(expr, symbols, slots, coefficients, monomials);
+    nterms = coefficients.size();
+
+    HornerPlanner planner(symbols.size());
+    nregisters = planner.Plan(coefficients, monomials, ops, &outputRegister);
+}
+
+/**
+ * Constructor. Compile the given expression with the
+ * given symbols fixed to numeric values (partial
+ * evaluation in floating-point arithmetic). The values
+ * are folded into the coefficients, and terms which
+ * become proportional are merged, so that the program
+ * only involves the remaining symbols.
+ *
+ * expr:  Expression to compile.
+ * fixed: Values of the symbols to fix.
+ */
+CompiledExpression::CompiledExpression(const Expression &expr, const map<string, double> &fixed) {
+    vector<double> coefficients;
+    vector<monomial> monomials;
+
+    Decompose(expr, symbols, slots, coefficients, monomials, &fixed);
+    nterms = coefficients.size();
+
+    HornerPlanner planner(symbols.size());
+    nregisters = planner.Plan(coefficients, monomials, ops, &outputRegister);
+}
+
+/**
+ * Destructor.
+ */
+CompiledExpression::~CompiledExpression() { }
+
+/**
+ * Split the given expression into a list of numeric
+ * coefficients and a list of distinct monomials, with
+ * repeated factors collapsed into powers.
+ *
+ * expr:         Expression to decompose.
+ * symbols:      Symbol table; new symbols are appended.
+ * slots:        Map from symbol name to index in 'symbols'.
+ * coefficients: Vector to store the coefficients in.
+ * monomials:    Vector to store the monomials in.
+ * fixed:        If not 'nullptr', symbols with values in
+ *               this table are multiplied into the
+ *               coefficients instead of being given slots.
+ */
+void CompiledExpression::Decompose(
+    const Expression &expr, vector<string> &symbols,
+    unordered_map<string, unsigned int> &slots,
+    vector<double> &coefficients, vector<monomial> &monomials,
+    const map<string, double> *fixed
+) {
+    vectorTermPtr terms = expr.GetTerms();
+    const vector<long long> &tcoeffs = expr.GetCoefficients();
+    vector<double> tcoefficients;
+    vector<monomial> tmonomials;
+    map<unsigned int, unsigned int> powers;
+
+    tcoefficients.reserve(terms->size());
+    tmonomials.reserve(terms->size());
+    for (size_t i = 0; i < terms->size(); i++) {
+        vectorFactorPtr facts = (*terms)[i]->GetFactors();
+        double coeff = (double)tcoeffs[i];
+
+        powers.clear();
+        for (vector<FactorPtr>::const_iterator jt = facts->begin(); jt != facts->end(); jt++) {
+            const FactorPtr &f = *jt;
+            if (f->IsNumber())
+                continue;
+
+            if (fixed != nullptr) {
+                map<string, double>::const_iterator ft = fixed->find(f->GetName());
+                if (ft != fixed->end()) {
+                    coeff *= ft->second;
+                    continue;
+                }
+            }
+
+            unordered_map<string, unsigned int>::const_iterator st = slots.find(f->GetName());
+            unsigned int s;
+            if (st != slots.end())
+                s = st->second;
+            else {
+                s = symbols.size();
+                symbols.push_back(f->GetName());
+                slots[f->GetName()] = s;
+            }
+
+            powers[s]++;
+        }
+
+        if (coeff == 0.0)
+            continue;
+
+        tcoefficients.push_back(coeff);
+        tmonomials.push_back(monomial(powers.begin(), powers.end()));
+    }
+
+    // Merge terms with equal monomials
+    vector<unsigned int> order(tmonomials.size());
+    for (unsigned int i = 0; i < order.size(); i++)
+        order[i] = i;
+    sort(order.begin(), order.end(), [&tmonomials](unsigned int a, unsigned int b) {
+        return tmonomials[a] < tmonomials[b];
+    });
+
+    coefficients.clear();
+    monomials.clear();
+    for (unsigned int i = 0; i < order.size(); i++) {
+        if (i > 0 && tmonomials[order[i]] == monomials.back())
+            coefficients.back() += tcoefficients[order[i]];
+        else {
+            coefficients.push_back(tcoefficients[order[i]]);
+            monomials.push_back(tmonomials[order[i]]);
+        }
+    }
+}
+
+/**
+ * Create a vector of symbol values from the given
+ * table of numeric substitutions, suitable for
+ * passing to 'Evaluate()'.
+ *
+ * subst: Table of numeric substitutions to make.
+ * other: Value to assign to symbols not found in table 'subst'.
+ */
+vector<double> CompiledExpression::Bind(const map<string, double> &subst, const double other) const {
+    vector<double> v(symbols.size(), other);
+
+    for (unsigned int s = 0; s < symbols.size(); s++) {
+        map<string, double>::const_iterator it = subst.find(symbols[s]);
+        if (it != subst.end())
+            v[s] = it->second;
+    }
+
+    return v;
+}
+
+/**
+ * Evaluate this expression numerically.
+ *
+ * values: Value of each symbol slot (array of length
+ *         'NumberOfSymbols()').
+ */
+double CompiledExpression::Evaluate(const double *values) const {
+    vector<double> reg(nregisters);
+    double *r = reg.data();
+
+    for (vector<eval_op>::const_iterator it = ops.begin(); it != ops.end(); it++) {
+        const eval_op &op = *it;
+        switch (op.type) {
+            case eval_op::LOAD:   r[op.dest] = values[op.a]; break;
+            case eval_op::CONST:  r[op.dest] = op.value; break;
+            case eval_op::ADD:    r[op.dest] = r[op.a] + r[op.b]; break;
+            case eval_op::MUL:    r[op.dest] = r[op.a] * r[op.b]; break;
+            case eval_op::MULADD: r[op.dest] = r[op.a] * r[op.b] + r[op.c]; break;
+            case eval_op::SCALE:  r[op.dest] = op.value * r[op.a]; break;
+        }
+    }
+
+    return r[outputRegister];
+}
+
+/**
+ * Evaluate this expression numerically with the
+ * given table of numeric substitutions.
+ *
+ * subst: Table of numeric substitutions to make.
+ * other: Value to assign to symbols not found in table 'subst'.
+ */
+double CompiledExpression::Evaluate(const map<string, double> &subst, const double other) const {
+    return Evaluate(Bind(subst, other));
+}
+
+/**
+ * Evaluate this expression numerically at many points.
+ * The points are processed in blocks of 'BLOCK_SIZE', and
+ * within a block every operation of the program is done
+ * for all points at once, so that the inner loops can be
+ * vectorized. The
+ * points are split evenly across 'nthreads' threads.
+ *
+ * columns:  Array of 'NumberOfSymbols()' pointers, where
+ *           'columns[s]' points to the values of slot 's'
+ *           at each of the points.
+ * npoints:  Number of points to evaluate at.
+ * out:      Array of length 'npoints' in which to store
+ *           the results.
+ * nthreads: Number of threads to use (0 = one per core).
+ */
+void CompiledExpression::Evaluate(
+    const double *const *columns, const size_t npoints,
+    double *out, unsigned int nthreads
+) const {
+    if (nthreads == 0)
+        nthreads = max(1u, thread::hardware_concurrency());
+
+    // No point in having a thread work on less than a block
+    nthreads = (unsigned int)min((size_t)nthreads, (npoints+BLOCK_SIZE-1) / BLOCK_SIZE);
+
+    if (nthreads <= 1) {
+        evaluate_range(columns, 0, npoints, out);
+        return;
+    }
+
+    vector<thread> threads;
+    size_t chunk = (npoints + nthreads - 1) / nthreads;
+    for (unsigned int i = 1; i < nthreads; i++) {
+        size_t begin = min(npoints, i*chunk), end = min(npoints, (i+1)*chunk);
+        threads.push_back(thread(&CompiledExpression::evaluate_range, this, columns, begin, end, out));
+    }
+
+    evaluate_range(columns, 0, min(npoints, chunk), out);
+
+    for (vector<thread>::iterator it = threads.begin(); it != threads.end(); it++)
+        it->join();
+}
+
+/**
+ * Evaluate this expression at the points 'begin' to
+ * 'end-1' (see 'Evaluate()' above).
+ */
+void CompiledExpression::evaluate_range(
+    const double *const *columns, const size_t begin, const size_t end,
+    double *out
+) const {
+    const unsigned int B = BLOCK_SIZE;
+    vector<double> reg(nregisters*B);
+    double *r = reg.data();
+
+    for (size_t offset = begin; offset < end; offset += B) {
+        const unsigned int n = (unsigned int)min((size_t)B, end-offset);
+
+        for (vector<eval_op>::const_iterator it = ops.begin(); it != ops.end(); it++) {
+            const eval_op &op = *it;
+            double *d = r + op.dest*B;
+            const double *a = r + op.a*B, *b = r + op.b*B, *c = r + op.c*B;
+
+            switch (op.type) {
+                case eval_op::LOAD: {
+                    const double *x = columns[op.a] + offset;
+                    for (unsigned int j = 0; j < n; j++) d[j] = x[j];
+                } break;
+                case eval_op::CONST:
+                    for (unsigned int j = 0; j < n; j++) d[j] = op.value;
+                    break;
+                case eval_op::ADD:
+                    for (unsigned int j = 0; j < n; j++) d[j] = a[j] + b[j];
+                    break;
+                case eval_op::MUL:
+                    for (unsigned int j = 0; j < n; j++) d[j] = a[j] * b[j];
+                    break;
+                case eval_op::MULADD:
+                    for (unsigned int j = 0; j < n; j++) d[j] = a[j] * b[j] + c[j];
+                    break;
+                case eval_op::SCALE:
+                    for (unsigned int j = 0; j < n; j++) d[j] = op.value * a[j];
+                    break;
+            }
+        }
+
+        const double *o = r + outputRegister*B;
+        for (unsigned int j = 0; j < n; j++)
+            out[offset+j] = o[j];
+    }
+}
+
+/**
+ * Evaluate this expression numerically, together with its
+ * partial derivatives with respect to the given symbols.
+ * The program is run on dual numbers: every register holds
+ * a value along with its derivative with respect to each
+ * of the requested symbols, so that the derivatives are
+ * exact (up to rounding) and obtained in the same pass.
+ *
+ * values:   Value of each symbol slot (array of length
+ *           'NumberOfSymbols()').
+ * wrt:      Slots of the symbols to differentiate with
+ *           respect to. Slots which are 'NO_SLOT' (symbols
+ *           which do not appear in the expression) give
+ *           zero derivatives.
+ * gradient: Array of length 'wrt.size()' in which to store
+ *           the partial derivatives.
+ */
+double CompiledExpression::EvaluateGradient(
+    const double *values, const vector<unsigned int> &wrt, double *gradient
+) const {
+    const unsigned int K = wrt.size(), W = K+1;
+    vector<double> reg(nregisters*W);
+    double *r = reg.data();
+
+    for (vector<eval_op>::const_iterator it = ops.begin(); it != ops.end(); it++) {
+        const eval_op &op = *it;
+        double *d = r + op.dest*W;
+        const double *a = r + op.a*W, *b = r + op.b*W, *c = r + op.c*W;
+
+        // Derivatives are computed before the value, since
+        // 'dest' may be the same register as an operand
+        switch (op.type) {
+            case eval_op::LOAD:
+                for (unsigned int k = 0; k < K; k++) d[k+1] = (wrt[k] == op.a ? 1.0 : 0.0);
+                d[0] = values[op.a];
+                break;
+            case eval_op::CONST:
+                for (unsigned int k = 0; k < K; k++) d[k+1] = 0.0;
+                d[0] = op.value;
+                break;
+            case eval_op::ADD:
+                for (unsigned int k = 1; k <= K; k++) d[k] = a[k] + b[k];
+                d[0] = a[0] + b[0];
+                break;
+            case eval_op::MUL:
+                for (unsigned int k = 1; k <= K; k++) d[k] = a[k]*b[0] + a[0]*b[k];
+                d[0] = a[0] * b[0];
+                break;
+            case eval_op::MULADD:
+                for (unsigned int k = 1; k <= K; k++) d[k] = a[k]*b[0] + a[0]*b[k] + c[k];
+                d[0] = a[0] * b[0] + c[0];
+                break;
+            case eval_op::SCALE:
+                for (unsigned int k = 1; k <= K; k++) d[k] = op.value * a[k];
+                d[0] = op.value * a[0];
+                break;
+        }
+    }
+
+    const double *o = r + outputRegister*W;
+    for (unsigned int k = 0; k < K; k++)
+        gradient[k] = o[k+1];
+
+    return o[0];
+}
+
+/**
+ * Evaluate this expression, together with its partial
+ * derivatives with respect to the given symbols, at many
+ * points (see 'Evaluate()' and 'EvaluateGradient()' above).
+ *
+ * columns:   Array of 'NumberOfSymbols()' pointers, where
+ *            'columns[s]' points to the values of slot 's'
+ *            at each of the points.
+ * npoints:   Number of points to evaluate at.
+ * wrt:       Slots of the symbols to differentiate with
+ *            respect to ('NO_SLOT' gives zero derivatives).
+ * out:       Array of length 'npoints' in which to store
+ *            the values.
+ * gradients: Array of 'wrt.size()' pointers, where
+ *            'gradients[k]' points to an array of length
+ *            'npoints' in which to store the derivative
+ *            with respect to 'wrt[k]'.
+ * nthreads:  Number of threads to use (0 = one per core).
+ */
+void CompiledExpression::EvaluateGradient(
+    const double *const *columns, const size_t npoints,
+    const vector<unsigned int> &wrt, double *out,
+    double *const *gradients, unsigned int nthreads
+) const {
+    if (nthreads == 0)
+        nthreads = max(1u, thread::hardware_concurrency());
+
+    nthreads = (unsigned int)min((size_t)nthreads, (npoints+BLOCK_SIZE-1) / BLOCK_SIZE);
+
+    if (nthreads <= 1) {
+        evaluate_gradient_range(columns, 0, npoints, &wrt, out, gradients);
+        return;
+    }
+
+    vector<thread> threads;
+    size_t chunk = (npoints + nthreads - 1) / nthreads;
+    for (unsigned int i = 1; i < nthreads; i++) {
+        size_t begin = min(npoints, i*chunk), end = min(npoints, (i+1)*chunk);
+        threads.push_back(thread(&CompiledExpression::evaluate_gradient_range, this, columns, begin, end, &wrt, out, gradients));
+    }
+
+    evaluate_gradient_range(columns, 0, min(npoints, chunk), &wrt, out, gradients);
+
+    for (vector<thread>::iterator it = threads.begin(); it != threads.end(); it++)
+        it->join();
+}
+
+/**
+ * Evaluate this expression and its partial derivatives
+ * at the points 'begin' to 'end-1' (see
+ * 'EvaluateGradient()' above). Component 'k' of register
+ * 'r' (where component 0 is the value) is stored at
+ * offset '(r*(K+1) + k)*BLOCK_SIZE'.
+ */
+void CompiledExpression::evaluate_gradient_range(
+    const double *const *columns, const size_t begin, const size_t end,
+    const vector<unsigned int> *wrt, double *out, double *const *gradients
+) const {
+    const unsigned int B = BLOCK_SIZE, K = wrt->size(), W = (K+1)*B;
+    vector<double> reg(nregisters*W);
+    double *r = reg.data();
+
+    for (size_t offset = begin; offset < end; offset += B) {
+        const unsigned int n = (unsigned int)min((size_t)B, end-offset);
+
+        for (vector<eval_op>::const_iterator it = ops.begin(); it != ops.end(); it++) {
+            const eval_op &op = *it;
+            double *d = r + op.dest*W;
+            const double *a = r + op.a*W, *b = r + op.b*W, *c = r + op.c*W;
+
+            switch (op.type) {
+                case eval_op::LOAD: {
+                    for (unsigned int k = 0; k < K; k++) {
+                        const double v = ((*wrt)[k] == op.a ? 1.0 : 0.0);
+                        for (unsigned int j = 0; j < n; j++) d[(k+1)*B+j] = v;
+                    }
+                    const double *x = columns[op.a] + offset;
+                    for (unsigned int j = 0; j < n; j++) d[j] = x[j];
+                } break;
+                case eval_op::CONST:
+                    for (unsigned int j = 0; j < K*B; j++) d[B+j] = 0.0;
+                    for (unsigned int j = 0; j < n; j++) d[j] = op.value;
+                    break;
+                case eval_op::ADD:
+                    for (unsigned int j = 0; j < (K+1)*B; j++) d[j] = a[j] + b[j];
+                    break;
+                case eval_op::MUL:
+                    for (unsigned int k = 1; k <= K; k++) {
+                        for (unsigned int j = 0; j < n; j++)
+                            d[k*B+j] = a[k*B+j]*b[j] + a[j]*b[k*B+j];
+                    }
+                    for (unsigned int j = 0; j < n; j++) d[j] = a[j] * b[j];
+                    break;
+                case eval_op::MULADD:
+                    for (unsigned int k = 1; k <= K; k++) {
+                        for (unsigned int j = 0; j < n; j++)
+                            d[k*B+j] = a[k*B+j]*b[j] + a[j]*b[k*B+j] + c[k*B+j];
+                    }
+                    for (unsigned int j = 0; j < n; j++) d[j] = a[j] * b[j] + c[j];
+                    break;
+                case eval_op::SCALE:
+                    for (unsigned int j = 0; j < (K+1)*B; j++) d[j] = op.value * a[j];
+                    break;
+            }
+        }
+
+        const double *o = r + outputRegister*W;
+        for (unsigned int j = 0; j < n; j++)
+            out[offset+j] = o[j];
+        for (unsigned int k = 0; k < K; k++) {
+            for (unsigned int j = 0; j < n; j++)
+                gradients[k][offset+j] = o[(k+1)*B+j];
+        }
+    }
+}
+
+/**
+ * Returns the number of floating-point multiplications
+ * needed to evaluate this expression once.
+ */
+unsigned int CompiledExpression::NumberOfMultiplications() const {
+    unsigned int n = 0;
+    for (vector<eval_op>::const_iterator it = ops.begin(); it != ops.end(); it++) {
+        if (it->type == eval_op::MUL || it->type == eval_op::MULADD || it->type == eval_op::SCALE)
+            n++;
+    }
+
+    return n;
+}
+
+/**
+ * Returns the slot of the symbol with the given
+ * name, or 'NO_SLOT' if the symbol does not appear
+ * in this expression.
+ */
+unsigned int CompiledExpression::GetSlot(const string &name) const {
+    unordered_map<string, unsigned int>::const_iterator it = slots.find(name);
+    if (it == slots.end())
+        return NO_SLOT;
+    else
+        return it->second;
+}
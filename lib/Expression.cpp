@@ -1,17 +1,42 @@
 /**
  * Implementation of the 'Expression' class.
+ *
+ * Besides its list of terms, an expression stores the
+ * numeric coefficient of each term in a contiguous array,
+ * in the same order as the terms. Operations on the whole
+ * expression which only involve the coefficients (such as
+ * checking for zero) sweep over this array rather than
+ * over the factors of every term. Similarly, the monomial
+ * of each term is stored packed (see 'PackedMonomial'), so
+ * that proportional terms are found by comparing words.
  */
 
 #include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <map>
 #include <string>
 #include <vector>
+#include "symachin/CompiledExpression.h"
 #include "symachin/Expression.h"
 #include "symachin/ExpressionParser.h"
+#include "symachin/FiniteField.h"
+#include "symachin/TermAccumulator.h"
 
 using namespace std;
 using namespace symachin;
 
+/**
+ * Seed of the point at which fingerprints are evaluated.
+ * Must never change, since fingerprints may be stored
+ * on disk by users of the library.
+ */
+const uint64_t Expression::FINGERPRINT_SEED = 0x5EED5EED5EED5EEDULL;
+
+const size_t Expression::DENSE_MAX_SIZE;
+const size_t Expression::DENSE_MIN_PRODUCTS;
+const size_t Expression::DENSE_MAX_FILL;
+
 /**
  * Constructor.
  */
@@ -22,12 +47,32 @@ Expression::Expression(Term &t) {
     TermPtr trm(new Term(t));
     terms = vectorTermPtr(new vector<TermPtr>());
     terms->push_back(trm);
+    UpdateFingerprint();
 }
 Expression::Expression(vectorTermPtr t) {
     terms = t;
+    UpdateFingerprint();
 }
 Expression::Expression(const string &exprstr) {
     terms = Parse(exprstr);
+    UpdateFingerprint();
+}
+/**
+ * Copy-constructor. The terms themselves are shared
+ * with the given expression, and are only copied when
+ * one of the expressions modifies them (see
+ * 'Term::Unshare()'). The list of term pointers and the
+ * coefficient and monomial columns are still copied, so
+ * copying takes time linear in the number of terms: the
+ * list may be modified in place through 'GetTerms()', and
+ * the columns of a copy are nearly always modified right
+ * away (by the operation the copy was made for).
+ */
+Expression::Expression(const Expression &e) {
+    terms = vectorTermPtr(new vector<TermPtr>(*e.GetTerms()));
+    coefficients = e.GetCoefficients();
+    monomials = e.monomials;
+    fingerprint = e.Fingerprint();
 }
 
 /**
@@ -51,10 +96,65 @@ bool Expression::HasTerm(const Term &t) const {
  * Check if the given expression is
  * equal to this expression.
  */
-bool Expression::IsEqual(Expression &expr) const {
-    ExpressionPtr ep(new Expression(*this));
-    ep->Subtract(expr);
-    return (ep->IsZero());
+bool Expression::IsEqual(const Expression &expr) const {
+    // Expressions with different fingerprints
+    // can never be equal
+    if (fingerprint != expr.Fingerprint())
+        return false;
+
+    // Sum the terms of both expressions (rather than
+    // subtracting from a copy), so that the result does not
+    // depend on the proportional terms of either expression
+    // having been merged
+    TermAccumulator acc;
+    for (vector<TermPtr>::const_iterator it = terms->begin(); it != terms->end(); it++) {
+        if (!(*it)->IsZero())
+            acc.Add(*it);
+    }
+
+    vectorTermPtr t = expr.GetTerms();
+    for (vector<TermPtr>::const_iterator it = t->begin(); it != t->end(); it++) {
+        if (!(*it)->IsZero()) {
+            TermPtr trm(new Term(*(*it)));
+            trm->Negate();
+            acc.Add(trm);
+        }
+    }
+
+    return acc.IsEmpty();
+}
+
+/**
+ * Check if the given expression is equal to this
+ * expression by evaluating both at 'npoints' random
+ * points in the finite field of 'FiniteField'
+ * (Schwartz-Zippel test). A 'false' result is always
+ * correct, while a 'true' result is wrong with a
+ * probability of at most (d/p)^npoints, where d is the
+ * largest degree of the two expressions and p is the
+ * prime of the field.
+ *
+ * expr:    Expression to compare with.
+ * npoints: Number of random points to evaluate at.
+ * errprob: If not 'nullptr', set to the upper bound for
+ *          the probability that a 'true' result is wrong.
+ */
+bool Expression::IsEqualRandomized(const Expression &expr, const unsigned int npoints, double *errprob) const {
+    if (fingerprint != expr.Fingerprint())
+        return false;
+
+    for (unsigned int i = 0; i < npoints; i++) {
+        uint64_t seed = FiniteField::RandomSeed();
+        if (EvaluateModular(seed) != expr.EvaluateModular(seed))
+            return false;
+    }
+
+    if (errprob != nullptr) {
+        double d = max(Degree(), expr.Degree());
+        *errprob = pow(d / (double)FiniteField::PRIME, (double)npoints);
+    }
+
+    return true;
 }
 
 /**
@@ -63,14 +163,30 @@ bool Expression::IsEqual(Expression &expr) const {
  * are zero).
  */
 bool Expression::IsZero() const {
-    for (vector<TermPtr>::const_iterator it = terms->begin(); it != terms->end(); it++) {
-        if (!(*it)->IsZero())
+    for (vector<long long>::const_iterator it = coefficients.begin(); it != coefficients.end(); it++) {
+        if (*it != 0)
             return false;
     }
 
     return true;
 }
 
+/**
+ * Returns the degree of this expression, i.e. the
+ * largest degree of any of its terms.
+ */
+unsigned int Expression::Degree() const {
+    unsigned int d = 0;
+    for (size_t i = 0; i < terms->size(); i++) {
+        if (monomials[i].IsValid())
+            d = max(d, monomials[i].Degree());
+        else
+            d = max(d, (*terms)[i]->Degree());
+    }
+
+    return d;
+}
+
 /**
  * Move all terms out of this expression
  * object, effectively clearing it.
@@ -78,16 +194,51 @@ bool Expression::IsZero() const {
 vectorTermPtr Expression::MoveTerms() {
     vectorTermPtr t = terms;
     terms = nullptr;
+    coefficients.clear();
+    monomials.clear();
+    fingerprint = 0;
     return t;
 }
 
+/**
+ * Replace the terms of this expression
+ * with the given terms.
+ */
+void Expression::SetTerms(vectorTermPtr t) {
+    terms = t;
+    UpdateFingerprint();
+}
+
+/**
+ * Recompute the fingerprint (and the coefficients and
+ * monomials) of this expression from scratch. The fingerprint is the
+ * value of the expression at a fixed point in the finite
+ * field of 'FiniteField'. It does not depend on the order
+ * of the terms, and is kept up-to-date by all operations
+ * on the expression, so this only needs to be called after
+ * modifying the terms returned by 'GetTerms()' directly.
+ */
+void Expression::UpdateFingerprint() {
+    update_columns();
+
+    fingerprint = 0;
+    if (terms != nullptr)
+        fingerprint = EvaluateModular(FINGERPRINT_SEED);
+}
+
 /**
  * Negate this expression.
  */
 void Expression::Negate() {
+    for (vector<long long>::iterator it = coefficients.begin(); it != coefficients.end(); it++)
+        *it = -(*it);
+
     for (vector<TermPtr>::iterator it = terms->begin(); it != terms->end(); it++) {
+        Term::Unshare(*it);
         (*it)->Negate();
     }
+
+    fingerprint = FiniteField::Negate(fingerprint);
 }
 
 /**
@@ -102,20 +253,32 @@ void Expression::Add(Factor &f) {
  * Add the given term to this expression.
  */
 void Expression::Add(Term &t) {
-    Add(this->terms, t);
+    long long c = coefficient(t);
+    if (c != 0) {
+        PackedMonomial m(t);
+        if (!merge(t, c, m))
+            append(TermPtr(new Term(t)), c, m);
+    }
+
+    fingerprint = FiniteField::Add(fingerprint, t.EvaluateModular(FINGERPRINT_SEED));
 }
 
 /**
- * Add the given terms to this expression.
+ * Add the given terms to this expression. Terms which
+ * are not merged with a term of this expression are
+ * shared with the given list.
  */
 void Expression::Add(vectorTermPtr t) {
-    for (vector<TermPtr>::iterator it = t->begin(); it != t->end(); it++)
-        Add(*(*it));
+    for (vector<TermPtr>::iterator it = t->begin(); it != t->end(); it++) {
+        long long c = coefficient(*(*it));
+        if (c != 0) {
+            PackedMonomial m(*(*it));
+            if (!merge(*(*it), c, m))
+                append(*it, c, m);
+        }
 
-    // The below is faster, but would require a separate
-    // implementation of cancellation
-    /*terms->reserve(terms->size() + t->size());
-    terms->insert(terms->end(), t->begin(), t->end());*/
+        fingerprint = FiniteField::Add(fingerprint, (*it)->EvaluateModular(FINGERPRINT_SEED));
+    }
 }
 
 /**
@@ -165,25 +328,39 @@ void Expression::Subtract(Expression &e) {
  * Multiply the given factor with this expression.
  */
 void Expression::Multiply(Factor &f) {
-    if (f.IsZero())
-        terms->clear();
-    else {
-        for (vector<TermPtr>::iterator it = terms->begin(); it != terms->end(); it++) {
-            (*it)->Multiply(f);
-        }
-    }
+    Term t(f);
+    Multiply(t);
 }
 
 /**
  * Multiply the given term with this expression.
  */
 void Expression::Multiply(Term &t) {
-    if (t.IsZero())
+    if (t.IsZero()) {
         terms->clear();
-    else {
+        coefficients.clear();
+        monomials.clear();
+        fingerprint = 0;
+    } else {
+        long long c = t.GetNumericFactorValue();
+        if (c == -1) {
+            for (vector<long long>::iterator it = coefficients.begin(); it != coefficients.end(); it++)
+                *it = -(*it);
+        } else if (c != 1) {
+            for (vector<long long>::iterator it = coefficients.begin(); it != coefficients.end(); it++)
+                *it = Factor::NumericProduct(*it, c);
+        }
+
+        PackedMonomial m(t);
+        for (vector<PackedMonomial>::iterator it = monomials.begin(); it != monomials.end(); it++)
+            *it = (*it) * m;
+
         for (vector<TermPtr>::iterator it = terms->begin(); it != terms->end(); it++) {
+            Term::Unshare(*it);
             (*it)->Multiply(t);
         }
+
+        fingerprint = FiniteField::Multiply(fingerprint, t.EvaluateModular(FINGERPRINT_SEED));
     }
 }
 
@@ -191,14 +368,22 @@ void Expression::Multiply(Term &t) {
  * Multiply the given terms with this expression.
  */
 void Expression::Multiply(vector<TermPtr> &t) {
+    uint64_t fp = 0;
+    for (vector<TermPtr>::const_iterator it = t.begin(); it != t.end(); it++)
+        fp = FiniteField::Add(fp, (*it)->EvaluateModular(FINGERPRINT_SEED));
+
     terms = Expression::Multiply(*terms, t);
+    update_columns();
+    fingerprint = FiniteField::Multiply(fingerprint, fp);
 }
 
 /**
  * Multiply the given expression with this expression.
  */
 void Expression::Multiply(Expression &e) {
-    Multiply(*(e.GetTerms()));
+    terms = Expression::Multiply(*terms, *(e.GetTerms()));
+    update_columns();
+    fingerprint = FiniteField::Multiply(fingerprint, e.Fingerprint());
 }
 
 /**
@@ -219,17 +404,31 @@ vectorExpressionPtr Expression::GroupBy(const vector<TermPtr> &exprs) const {
 
     // First, make a copy of the terms to group
     vectorTermPtr t(new vector<TermPtr>(*terms));
+    vector<PackedMonomial> m(monomials);
 
     for (vector<TermPtr>::const_iterator it = exprs.begin(); it != exprs.end(); it++) {
         const TermPtr &ft = *it;
         vectorTermPtr group(new vector<TermPtr>());
 
+        // Numeric factors must be matched too, which
+        // packed monomials cannot do
+        PackedMonomial fm(*ft);
+        if (ft->HasNumericFactor())
+            fm = PackedMonomial::Invalid();
+
         for (unsigned int i = 0; i < t->size(); i++) {
-            if (t->at(i)->ContainsTerm(*ft)) {
+            bool contains;
+            if (fm.IsValid() && m[i].IsValid())
+                contains = fm.Divides(m[i]);
+            else
+                contains = t->at(i)->ContainsTerm(*ft);
+
+            if (contains) {
                 TermPtr trm(new Term(*(t->at(i))));
                 trm->RemoveTerm(*(*it));
                 group->push_back(trm);
-                t->erase(std::remove(t->begin(), t->end(), t->at(i)), t->end());
+                t->erase(t->begin() + i);
+                m.erase(m.begin() + i);
                 i--;
             }
         }
@@ -278,23 +477,116 @@ string Expression::ToString(bool formatted) {
 
 /**
  * Evaluate this expression numerically with the given
- * table of numeric substitutions.
+ * table of numeric substitutions. To evaluate the same
+ * expression many times, use a 'CompiledExpression'
+ * directly instead.
  * 
  * subst: Table of numeric substitutions to make.
  * other: Value to assign to tokens not found in table 'subst'.
  */
 double Expression::Evaluate(const map<string, double>& subst, const double other) const {
-    double total = 0.0;
+    CompiledExpression ce(*this);
+    return ce.Evaluate(subst, other);
+}
+
+/**
+ * Evaluate this expression in the finite field of
+ * 'FiniteField', with every symbol replaced by its
+ * pseudo-random value for the given seed.
+ *
+ * seed: Seed identifying the point of evaluation.
+ */
+uint64_t Expression::EvaluateModular(const uint64_t seed) const {
+    uint64_t total = 0;
 
     for (vector<TermPtr>::const_iterator it = terms->begin(); it != terms->end(); it++)
-        total += (*it)->Evaluate(subst, other);
+        total = FiniteField::Add(total, (*it)->EvaluateModular(seed));
 
     return total;
 }
 
+/**********************
+ * INTERNAL FUNCTIONS *
+ **********************/
+/**
+ * Append the given term, with the given coefficient
+ * and packed monomial, to this expression.
+ */
+void Expression::append(const TermPtr &t, const long long c, const PackedMonomial &m) {
+    terms->push_back(t);
+    coefficients.push_back(c);
+    monomials.push_back(m);
+}
+
+/**
+ * Check if a term proportional to the given term (with
+ * the given coefficient and packed monomial) exists in
+ * this expression, and if so, merge them (removing the
+ * term if they cancel). Returns 'false' if there is no
+ * such term.
+ */
+bool Expression::merge(const Term &t, const long long c, const PackedMonomial &m) {
+    for (size_t i = 0; i < terms->size(); i++) {
+        TermPtr &trm = (*terms)[i];
+
+        // A packed monomial is only ever equal to another
+        // packed monomial; compare the factors otherwise
+        if (m.IsValid()) {
+            if (m != monomials[i])
+                continue;
+        } else if (monomials[i].IsValid() || !t.IsProportional(trm))
+            continue;
+
+        long long sum = Factor::NumericSum(coefficients[i], c);
+
+        if (sum == 0) { // Pre-factor is zero => cancel term
+            terms->erase(terms->begin() + i);
+            coefficients.erase(coefficients.begin() + i);
+            monomials.erase(monomials.begin() + i);
+        } else {
+            Term::Unshare(trm);
+            trm->SetNumericFactorValue(sum);
+            coefficients[i] = sum;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Recompute the coefficients and packed monomials
+ * of the terms of this expression.
+ */
+void Expression::update_columns() {
+    coefficients.clear();
+    monomials.clear();
+    if (terms == nullptr)
+        return;
+
+    coefficients.reserve(terms->size());
+    monomials.reserve(terms->size());
+    for (vector<TermPtr>::const_iterator it = terms->begin(); it != terms->end(); it++) {
+        coefficients.push_back(coefficient(*(*it)));
+        monomials.push_back(PackedMonomial(*(*it)));
+    }
+}
+
 /********************
  * STATIC FUNCTIONS *
  ********************/
+/**
+ * Returns the numeric coefficient of the given
+ * term, including its sign (zero if the term is).
+ */
+long long Expression::coefficient(const Term &t) {
+    if (t.IsZero())
+        return 0;
+
+    return t.GetNumericFactorValue();
+}
+
 /**
  * Add the given term to the given expression.
  */
@@ -302,61 +594,228 @@ void Expression::Add(vectorTermPtr trms, const Term &t) {
     if (t.IsZero())
         return;
 
-    // Check if a proportional term
-    // already exists, and if so, merge them
-    for (vector<TermPtr>::iterator it = trms->begin(); it != trms->end(); it++) {
-        if (t.IsProportional(*it)) {
-            int ne = (*it)->GetNumericFactorValue();
-            int nt = t.GetNumericFactorValue();
-            int sum = ne+nt;
-
-            FactorPtr nf;
-            if (sum > 0)
-                nf = FactorPtr(new Factor(to_string(sum)));
-            else if (sum < 0)
-                nf = FactorPtr(new Factor(to_string(-sum), SYMACHIN_SIGN_NEG));
-            else {  // Pre-factor is zero => cancel term
-                trms->erase(it);
-                return;
-            }
+    // Merge with a proportional term, or append it
+    if (!merge(trms, t))
+        trms->push_back(TermPtr(new Term(t)));
+}
 
-            vectorFactorPtr nfac = (*it)->GetNonNumericFactors();
-            if (abs(sum) != 1)
-                nfac->push_back(nf);
+/**
+ * Add the given term to the given expression, sharing
+ * the term if it is appended.
+ */
+void Expression::Add(vectorTermPtr trms, const TermPtr &t) {
+    if (t->IsZero())
+        return;
 
-            (*it)->ReplaceFactors(nfac);
+    if (!merge(trms, *t))
+        trms->push_back(t);
+}
 
-            if ((sum > 0 && (*it)->GetSign() == SYMACHIN_SIGN_NEG) ||
-                (sum < 0 && (*it)->GetSign() == SYMACHIN_SIGN_POS)) {
-                (*it)->Negate();
+/**
+ * Check if a term proportional to the given term
+ * exists in the given expression, and if so, merge
+ * them (removing the term if they cancel). Returns
+ * 'false' if there is no such term.
+ */
+bool Expression::merge(vectorTermPtr trms, const Term &t) {
+    for (vector<TermPtr>::iterator it = trms->begin(); it != trms->end(); it++) {
+        if (t.IsProportional(*it)) {
+            long long ne = (*it)->GetNumericFactorValue();
+            long long nt = t.GetNumericFactorValue();
+            long long sum = Factor::NumericSum(ne, nt);
+
+            if (sum == 0)   // Pre-factor is zero => cancel term
+                trms->erase(it);
+            else {
+                Term::Unshare(*it);
+                (*it)->SetNumericFactorValue(sum);
             }
 
-            return;
+            return true;
         }
     }
 
-    // Otherwise, just append the term
-    TermPtr trm(new Term(t));
-    trms->push_back(trm);
+    return false;
 }
 
 /**
- * Multiply two expressions together.
+ * Multiply two expressions together. The monomials of
+ * the factors are packed once, so that the monomial of
+ * each product is found by adding words, and is compared
+ * with the products found so far by comparing words.
+ * The symbols of the factors are numbered afresh for
+ * packing (see 'PackedMonomial::Slots()'), so that any
+ * expressions in at most 32 symbols can be packed,
+ * whichever symbols were interned first. Expressions in
+ * a few symbols of low degree are multiplied densely (see
+ * 'multiply_dense()').
  */
 vectorTermPtr Expression::Multiply(const vector<TermPtr> &t1, const vector<TermPtr> &t2) {
-    vectorTermPtr newTerms(new vector<TermPtr>());
+    Expression product;
+    vector<PackedMonomial> m1, m2;
+    vector<unsigned int> slots = PackedMonomial::Slots(t1, t2);
+
+    product.terms = vectorTermPtr(new vector<TermPtr>());
+
+    // Symbols with small indices already have fields
+    // of their own
+    if (!slots.empty() && slots.back() < PackedMonomial::MAX_SYMBOLS)
+        slots.clear();
+
+    m1.reserve(t1.size());
+    for (vector<TermPtr>::const_iterator it = t1.begin(); it != t1.end(); it++)
+        m1.push_back(slots.empty() ? PackedMonomial(*(*it)) : PackedMonomial(*(*it), slots));
+    m2.reserve(t2.size());
+    for (vector<TermPtr>::const_iterator it = t2.begin(); it != t2.end(); it++)
+        m2.push_back(slots.empty() ? PackedMonomial(*(*it)) : PackedMonomial(*(*it), slots));
+
+    vectorTermPtr dense = multiply_dense(t1, t2, m1, m2);
+    if (dense != nullptr)
+        return dense;
+
+    for (size_t j = 0; j < t2.size(); j++) {
+        for (size_t i = 0; i < t1.size(); i++) {
+            TermPtr trm(new Term(*t1[i]));
+            trm->Multiply(*t2[j]);
+
+            long long c = coefficient(*trm);
+            if (c == 0)
+                continue;
+
+            PackedMonomial m = m1[i] * m2[j];
+            if (!product.merge(*trm, c, m))
+                product.append(trm, c, m);
+        }
+    }
 
-    for (vector<TermPtr>::const_iterator it = t2.begin(); it != t2.end(); it++) {
-        for (vector<TermPtr>::const_iterator jt = t1.begin(); jt != t1.end(); jt++) {
-            TermPtr trm(new Term(*(*jt)));
-            trm->Multiply(*(*it));
+    return product.MoveTerms();
+}
+/**
+ * Multiply two expressions using an array of coefficients
+ * indexed by Kronecker substitution: with D[v] the largest
+ * exponent of symbol 'v' in the product, a monomial is
+ * mapped to the index
+ *
+ *   sum_v e[v] * (D[0]+1) * ... * (D[v-1]+1),
+ *
+ * so that the index of a product is the sum of the indices
+ * of its factors, and a product is merged with an earlier
+ * product by a single array access. The products are
+ * accumulated in the same order as in 'Multiply()', keeping
+ * track of the product each resulting term was created
+ * from and of the order in which the terms were created,
+ * so that the result is identical to that of the sparse
+ * multiplication. Only the terms of the result are ever
+ * constructed. Returns 'nullptr' if the expressions are
+ * not suited for dense multiplication (too few products,
+ * or too large an array).
+ *
+ * t1, t2: Expressions to multiply.
+ * m1, m2: Packed monomials of the terms of 't1' and 't2'.
+ */
+vectorTermPtr Expression::multiply_dense(
+    const vector<TermPtr> &t1, const vector<TermPtr> &t2,
+    const vector<PackedMonomial> &m1, const vector<PackedMonomial> &m2
+) {
+    const size_t n1 = t1.size(), n2 = t2.size();
+    const unsigned int nsymbols = PackedMonomial::MAX_SYMBOLS;
+    unsigned int d1[nsymbols] = {0}, d2[nsymbols] = {0};
+    size_t stride[nsymbols], size = 1;
+
+    if (n1 * n2 < DENSE_MIN_PRODUCTS)
+        return nullptr;
+
+    for (size_t i = 0; i < n1; i++) {
+        if (!m1[i].IsValid())
+            return nullptr;
+        for (unsigned int v = 0; v < nsymbols; v++)
+            d1[v] = max(d1[v], m1[i].Exponent(v));
+    }
+    for (size_t j = 0; j < n2; j++) {
+        if (!m2[j].IsValid())
+            return nullptr;
+        for (unsigned int v = 0; v < nsymbols; v++)
+            d2[v] = max(d2[v], m2[j].Exponent(v));
+    }
+
+    for (unsigned int v = 0; v < nsymbols; v++) {
+        stride[v] = size;
+        size *= d1[v] + d2[v] + 1;
 
-            Add(newTerms, *trm);
+        if (size > DENSE_MAX_SIZE || size > DENSE_MAX_FILL * n1 * n2)
+            return nullptr;
+    }
+
+    // Index and coefficient of every term
+    vector<size_t> index1(n1, 0), index2(n2, 0);
+    vector<long long> c1(n1), c2(n2);
+    for (size_t i = 0; i < n1; i++) {
+        for (unsigned int v = 0; v < nsymbols; v++)
+            index1[i] += m1[i].Exponent(v) * stride[v];
+        c1[i] = coefficient(*t1[i]);
+    }
+    for (size_t j = 0; j < n2; j++) {
+        for (unsigned int v = 0; v < nsymbols; v++)
+            index2[j] += m2[j].Exponent(v) * stride[v];
+        c2[j] = coefficient(*t2[j]);
+    }
+
+    // For every monomial: its coefficient, the product
+    // its term was created from (j*n1 + i), when that
+    // term was created, and whether other products have
+    // been merged into it
+    vector<long long> sums(size, 0);
+    vector<size_t> product(size), created(size);
+    vector<bool> merged(size, false);
+    size_t ncreated = 0;
+
+    for (size_t j = 0; j < n2; j++) {
+        for (size_t i = 0; i < n1; i++) {
+            if (c1[i] == 0 || c2[j] == 0)
+                continue;
+
+            long long c = Factor::NumericProduct(c1[i], c2[j]);
+            size_t k = index1[i] + index2[j];
+
+            if (sums[k] == 0) {
+                sums[k] = c;
+                product[k] = j*n1 + i;
+                created[k] = ncreated++;
+                merged[k] = false;
+            } else {
+                // Cancelled terms are created anew
+                // by the next product
+                sums[k] = Factor::NumericSum(sums[k], c);
+                merged[k] = true;
+            }
         }
     }
 
+    vector<size_t> result;
+    for (size_t k = 0; k < size; k++) {
+        if (sums[k] != 0)
+            result.push_back(k);
+    }
+
+    sort(result.begin(), result.end(), [&created](size_t a, size_t b) {
+        return created[a] < created[b];
+    });
+
+    vectorTermPtr newTerms(new vector<TermPtr>());
+    newTerms->reserve(result.size());
+    for (vector<size_t>::const_iterator it = result.begin(); it != result.end(); it++) {
+        TermPtr trm(new Term(*t1[product[*it] % n1]));
+        trm->Multiply(*t2[product[*it] / n1]);
+
+        if (merged[*it])
+            trm->SetNumericFactorValue(sums[*it]);
+
+        newTerms->push_back(trm);
+    }
+
     return newTerms;
 }
+
 vectorTermPtr Expression::Multiply(const Term &t1, const vector<TermPtr> &t2) {
     vector<TermPtr> t;
     t.push_back(TermPtr(new Term(t1)));
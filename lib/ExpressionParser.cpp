@@ -1,20 +1,50 @@
 /**
  * Implementation of the 'ExpressionParser' class.
+ *
+ * The parser reads the input in a single pass by
+ * recursive descent, directly from the input buffer.
+ * Products of plain symbols and numbers (by far the most
+ * common kind of term) are built as single terms and
+ * summed in a 'TermAccumulator', so that parsing an
+ * expanded expression takes time linear in its length.
+ *
+ * Very long expressions are split into chunks at top-level
+ * '+' and '-' signs and the chunks are parsed concurrently.
+ * The terms of the chunks are then summed, again one chunk
+ * per thread, by 'TermAccumulator::Sum()', which gives the
+ * same result (including the order of the terms) as
+ * parsing serially.
  */
 
+#include <algorithm>
+#include <exception>
 #include <string>
+#include <thread>
 #include <vector>
 #include "symachin/Expression.h"
 #include "symachin/ExpressionParser.h"
 #include "symachin/ExpressionParserException.h"
+#include "symachin/Factor.h"
+#include "symachin/Term.h"
+#include "symachin/TermAccumulator.h"
 
 using namespace std;
 using namespace symachin;
 
+const size_t ExpressionParser::PARALLEL_CHUNK_SIZE;
+
 /**
  * Constructor.
+ *
+ * nthreads: Number of threads to use when parsing long
+ *           expressions (0 = one per core).
  */
-ExpressionParser::ExpressionParser() {}
+ExpressionParser::ExpressionParser(unsigned int nthreads) {
+    if (nthreads == 0)
+        nthreads = max(1u, thread::hardware_concurrency());
+
+    this->nthreads = nthreads;
+}
 
 /**
  * Parse the given string as a mathematical
@@ -25,160 +55,196 @@ ExpressionParser::ExpressionParser() {}
  *   3. MULTIPLICATION (*)
  *   4. PARANTHESES    ( '(', '[', '{', ')', ']', '}' )
  *   5. OTHER TEXT
+ *
+ * A sum, or the contents of a parenthesis, may start
+ * with a sign.
  */
 ExpressionPtr ExpressionParser::Parse(const string &expr) {
-    return Parse(&expr);
+    return Parse(expr.data(), expr.size());
 }
 ExpressionPtr ExpressionParser::Parse(const string *expr) {
-    buffer = new string(*expr);
-    bufindx = -1;
+    return Parse(expr->data(), expr->size());
+}
+ExpressionPtr ExpressionParser::Parse(const char *buffer, const size_t length) {
+    return ExpressionPtr(new Expression(ParseTerms(buffer, length)));
+}
 
-    operator_stack.clear();
-    symbol_stack.clear();
+/**
+ * Parse the given buffer as a mathematical expression,
+ * and return the terms of the expression.
+ *
+ * buffer: Buffer containing the expression (need not
+ *         be null-terminated).
+ * length: Number of characters in the buffer.
+ */
+vectorTermPtr ExpressionParser::ParseTerms(const char *buffer, const size_t length) {
+    // No point in having a thread parse less than a chunk
+    unsigned int n = (unsigned int)min((size_t)nthreads, length / PARALLEL_CHUNK_SIZE);
+
+    if (n <= 1)
+        return parse(buffer, length);
+    else
+        return parse_parallel(buffer, length, n);
+}
 
-    // Pre-process string
-    PreProcessBuffer();
+/**
+ * Parse the given buffer on the calling thread
+ * (see 'ParseTerms()').
+ *
+ * buffer:   Buffer containing the expression.
+ * length:   Number of characters in the buffer.
+ * unmerged: If not 'nullptr', the terms of the top-level
+ *           sum are appended to this list without being
+ *           summed, and 'nullptr' is returned.
+ */
+vectorTermPtr ExpressionParser::parse(const char *buffer, const size_t length, vector<TermPtr> *unmerged) {
+    pos = buffer;
+    end = buffer + length;
+
+    next();
+    if (tkn == END)
+        throw ExpressionParserException("Expression stack does not contain a single element as expected.");
 
-    // Convert string to tokens in Postfix form
-    ToPostfix();
+    vectorTermPtr terms = parse_sum(unmerged);
 
-    // Now, the output stack is set up as
-    // a postfix expression and is ready to
-    // be interpreted.
-    ExpressionPtr e = ParsePostfix();
+    if (tkn == RPAR)
+        throw ExpressionParserException("Mismatched parenthesis in expression.");
+    else if (tkn != END)
+        throw ExpressionParserException("Syntax error in expression.");
 
-    return e;
+    return terms;
 }
 
 /**
- * Parse an expression in postfix form.
+ * Parse the given buffer by splitting it into 'n' chunks,
+ * which are parsed on separate threads. The top-level
+ * terms of the chunks are then summed as consecutive runs
+ * (see 'TermAccumulator::Sum()'), giving exactly the
+ * result of 'parse_sum()'.
+ *
+ * buffer: Buffer containing the expression.
+ * length: Number of characters in the buffer.
+ * n:      Number of chunks/threads to use.
  */
-ExpressionPtr ExpressionParser::ParsePostfix() {
-    vector<ExpressionPtr> *exprs = new vector<ExpressionPtr>();
-
-    for (
-        vector<struct intp_token*>::iterator it = output_queue.begin();
-        it != output_queue.end();
-        it++
-    ) {
-        struct intp_token *tkn = *it;
-
-        // If operator...
-        if (tkn->type == SYMACHIN_TTYPE_OPERATOR) {
-            if (exprs->size() < 2)
-                throw ExpressionParserException("Syntax error in expression.");
-
-            ExpressionPtr op2 = exprs->back();
-            exprs->pop_back();
-            ExpressionPtr op1 = exprs->back();
-            exprs->pop_back();
-
-            switch (tkn->text.front()) {
-                case '+':
-                    op1->Add(*op2);
-                    break;
-                case '-':
-                    if (op1->IsZero()) {
-                        op1 = op2;
-                        op1->Negate();
-                    } else
-                        op1->Subtract(*op2);
-                    break;
-                case '*':
-                    op1->Multiply(*op2);
-                    break;
-                default:
-                    throw ExpressionParserException("Unrecognized operator: "+tkn->text);
-            }
-
-            exprs->push_back(op1);
-        } else {       // Symbol
-            Term t(tkn->text);
-            ExpressionPtr ep(new Expression(t));
-            exprs->push_back(ep);
+vectorTermPtr ExpressionParser::parse_parallel(const char *buffer, const size_t length, const unsigned int n) {
+    vector<const char*> splits = split(buffer, length, n);
+    size_t nchunks = splits.size() - 1;
+
+    if (nchunks <= 1)
+        return parse(buffer, length);
+
+    vector<vector<TermPtr>> chunks(nchunks);
+    vector<exception_ptr> errors(nchunks);
+
+    auto work = [&splits, &chunks, &errors](const size_t i) {
+        try {
+            ExpressionParser p(1);
+            p.parse(splits[i], splits[i+1] - splits[i], &chunks[i]);
+        } catch (...) {
+            errors[i] = current_exception();
         }
-    }
+    };
 
-    if (exprs->size() != 1)
-        throw ExpressionParserException("Expression stack does not contain a single element as expected.");
+    vector<thread> threads;
+    for (size_t i = 1; i < nchunks; i++)
+        threads.push_back(thread(work, i));
+
+    work(0);
 
-    ExpressionPtr expr = exprs->back();
-    exprs->pop_back();
+    for (vector<thread>::iterator it = threads.begin(); it != threads.end(); it++)
+        it->join();
 
-    return expr;
+    // Report the first error in the expression
+    for (vector<exception_ptr>::const_iterator it = errors.begin(); it != errors.end(); it++) {
+        if (*it)
+            rethrow_exception(*it);
+    }
+
+    return TermAccumulator::Sum(chunks);
 }
 
 /**
- * Pre-process the buffer:
- *   - Make sure that if the first non-ignoreable
- *     character of the buffer is an operator, a
- *     zero is inserted right before it.
+ * Parse a sum of products, optionally preceded by a sign.
+ * Stops at the first token which is not part of the sum.
+ *
+ * unmerged: If not 'nullptr', the terms of the products
+ *           are appended to this list (in order) instead of
+ *           being summed, and 'nullptr' is returned.
  */
-void ExpressionParser::PreProcessBuffer() {
-    unsigned int i, l = buffer->length();
-    for (i = 0; i < l; i++) {
-        if (is_ignoreable(buffer->at(i)))
-            continue;
-        else if (is_operator(buffer->at(i)))
-            buffer->insert(0, "0");
-
-        break;
+vectorTermPtr ExpressionParser::parse_sum(vector<TermPtr> *unmerged) {
+    TermAccumulator acc;
+    token_type sign = PLUS;
+
+    if (tkn == PLUS || tkn == MINUS) {
+        sign = tkn;
+        next();
     }
+
+    for (;;) {
+        vectorTermPtr product = parse_product();
+        for (vector<TermPtr>::iterator it = product->begin(); it != product->end(); it++) {
+            // Zero terms are dropped, as by 'Expression::Add()'
+            if ((*it)->IsZero())
+                continue;
+
+            if (sign == MINUS)
+                (*it)->Negate();
+
+            if (unmerged != nullptr)
+                unmerged->push_back(*it);
+            else
+                acc.Add(*it);
+        }
+
+        if (tkn != PLUS && tkn != MINUS)
+            break;
+
+        sign = tkn;
+        next();
+    }
+
+    return (unmerged != nullptr ? nullptr : acc.Terms());
 }
 
 /**
- * Convert the buffer string to postfix notation.
+ * Parse a product of symbols and parenthesized sums.
+ * As long as no parenthesis is encountered, the product
+ * is a single term.
  */
-void ExpressionParser::ToPostfix() {
-    struct intp_token *tkn;
-    while (!eoe() && (tkn=next())!=nullptr) {
-        switch (tkn->type) {
-            case SYMACHIN_TTYPE_SYMBOL:
-                output_queue.push_back(tkn);
-                break;
-            case SYMACHIN_TTYPE_OPERATOR: {
-                while (
-                    operator_stack.size() > 0 &&
-                    operator_stack.back()->precedence >= tkn->precedence &&
-                    operator_stack.back()->type != SYMACHIN_TTYPE_LPAR
-                ) {
-                    output_queue.push_back(operator_stack.back());
-                    operator_stack.pop_back();
-                }
+vectorTermPtr ExpressionParser::parse_product() {
+    vectorTermPtr product;
+
+    for (;;) {
+        if (tkn == SYMBOL) {
+            FactorPtr f = Factor::Intern(tknbegin, tknlength);
+            if (product == nullptr) {
+                product = vectorTermPtr(new vector<TermPtr>());
+                product->push_back(TermPtr(new Term(vectorFactorPtr(new vector<FactorPtr>(1, f)))));
+            } else {
+                for (vector<TermPtr>::iterator it = product->begin(); it != product->end(); it++)
+                    (*it)->Multiply(f);
+            }
 
-                operator_stack.push_back(tkn);
-            } break;
-            case SYMACHIN_TTYPE_LPAR:
-                operator_stack.push_back(tkn);
-                break;
-            case SYMACHIN_TTYPE_RPAR: {
-                while (
-                    operator_stack.size() > 0 &&
-                    operator_stack.back()->type != SYMACHIN_TTYPE_LPAR
-                ) {
-                    output_queue.push_back(operator_stack.back());
-                    operator_stack.pop_back();
-                }
+            next();
+        } else if (tkn == LPAR) {
+            next();
+            vectorTermPtr sum = parse_sum();
 
-                if (operator_stack.size() == 0)
-                    throw ExpressionParserException("Mismatched parenthesis in expression.");
-
-                // Pop left parenthesis
-                struct intp_token *tok = operator_stack.back();
-                operator_stack.pop_back();
-                delete tok;
-                delete tkn;
-            } break;
-            default:
-                throw ExpressionParserException("Unrecognized token type.");
-        }
-    }
+            if (tkn != RPAR)
+                throw ExpressionParserException("Mismatched parenthesis in expression.");
+            next();
+
+            if (product == nullptr)
+                product = sum;
+            else
+                product = Expression::Multiply(*product, *sum);
+        } else
+            throw ExpressionParserException("Syntax error in expression.");
 
-    while (operator_stack.size() > 0) {
-        if (operator_stack.back()->type == SYMACHIN_TTYPE_LPAR)
-            throw ExpressionParserException("Mismatched parenthesis in expression.");
-        output_queue.push_back(operator_stack.back());
-        operator_stack.pop_back();
+        if (tkn != MULTIPLICATION)
+            return product;
+
+        next();
     }
 }
 
@@ -186,104 +252,79 @@ void ExpressionParser::ToPostfix() {
  * INTERNAL FUNCTIONS *
  **********************/
 /**
- * End-of-expression reached?
+ * Read the next token from the input.
  */
-bool ExpressionParser::eoe() const { return (bufindx >= (signed)buffer->size()); }
-
-/**
- * Check if the given character is ignorable.
- */
-bool ExpressionParser::is_ignoreable(char c) const {
-    switch (c) {
-        case ' ': case '\t': case '\n': return true;
-        default: return false;
+void ExpressionParser::next() {
+    // Skip whitespace
+    while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r'))
+        pos++;
+
+    tknbegin = pos;
+    tknlength = 1;
+
+    if (pos == end) {
+        tkn = END;
+        tknlength = 0;
+        return;
     }
-}
 
-/**
- * Check if the given character classifies as an operator.
- * Returns the operator precedence level.
- */
-int ExpressionParser::is_operator(char c) const {
-    switch (c) {
-        case '+': return 1;
-        case '-': return 2;
-        case '*': return 3;
-        default:
-            return 0;
+    switch (*pos) {
+        case '+': tkn = PLUS; pos++; return;
+        case '-': tkn = MINUS; pos++; return;
+        case '*': tkn = MULTIPLICATION; pos++; return;
+        case '(': case '[': case '{': tkn = LPAR; pos++; return;
+        case ')': case ']': case '}': tkn = RPAR; pos++; return;
+        default: break;
     }
-}
 
-/**
- * Check if the given character is a parenthesis.
- * Returns either 'SYMACHIN_TTYPE_LPAR' or 
- * 'SYMACHIN_TTYPE_RPAR' if the character is a left
- * or right parenthesis, respectively, and returns
- * 'SYMACHIN_TTYPE_SYMBOL' otherwise.
- */
-enum intp_ttype ExpressionParser::is_parenthesis(char c) const {
-    switch (c) {
-        case '(':
-        case '[':
-        case '{':
-            return SYMACHIN_TTYPE_LPAR;
-        case ')':
-        case ']':
-        case '}':
-            return SYMACHIN_TTYPE_RPAR;
-        default:
-            return SYMACHIN_TTYPE_SYMBOL;
+    tkn = SYMBOL;
+    for (pos++; pos < end; pos++) {
+        switch (*pos) {
+            case ' ': case '\t': case '\n': case '\r':
+            case '+': case '-': case '*':
+            case '(': case '[': case '{':
+            case ')': case ']': case '}':
+                tknlength = pos - tknbegin;
+                return;
+            default: break;
+        }
     }
-}
 
+    tknlength = pos - tknbegin;
+}
 
 /**
- * Get the next token in the stream.
+ * Find points at which to split the given buffer into
+ * (at most) 'n' chunks of roughly equal length. Chunks
+ * are split just before a '+' or '-' which is not inside
+ * a parenthesis, so that each chunk is a valid sum on its
+ * own. Returns the start of each chunk, followed by the end
+ * of the buffer.
+ *
+ * buffer: Buffer to split.
+ * length: Number of characters in the buffer.
+ * n:      Desired number of chunks.
  */
-struct intp_token *ExpressionParser::next() {
-    string s;
-    char c;
-    struct intp_token *tok = new struct intp_token;
-    int p;
-    tok->precedence = 0;
-
-    for (bufindx++; !eoe(); bufindx++) {
-        c = buffer->at(bufindx);
-        if (is_ignoreable(c)) {
-            if (s.length() == 0)
-                continue;
-            else {
-                break;
-            }
-        } else if ((p=is_operator(c)) > 0) {
-            if (s.length() > 0) {
-                bufindx--;
-                break;
-            } else {
-                tok->type = SYMACHIN_TTYPE_OPERATOR;
-                tok->precedence = p;
-                tok->text = c;
-                return tok;
-            }
-        } else if ((tok->type=is_parenthesis(c)) != SYMACHIN_TTYPE_SYMBOL) {
-            if (s.length() > 0) {
-                bufindx--;
+vector<const char*> ExpressionParser::split(const char *buffer, const size_t length, const unsigned int n) const {
+    vector<const char*> splits;
+    const char *p = buffer, *e = buffer + length;
+    long depth = 0;
+
+    splits.push_back(buffer);
+    for (size_t target = length / n; p < e && splits.size() < n; p++) {
+        switch (*p) {
+            case '(': case '[': case '{': depth++; break;
+            case ')': case ']': case '}': depth--; break;
+            case '+': case '-':
+                if (depth == 0 && p >= buffer + target) {
+                    splits.push_back(p);
+                    target += length / n;
+                }
                 break;
-            } else {
-                if (tok->type == SYMACHIN_TTYPE_LPAR)
-                    tok->text = '(';
-                else if (tok->type == SYMACHIN_TTYPE_RPAR)
-                    tok->text = ')';
-                return tok;
-            }
-        } else
-            s += c;
+            default: break;
+        }
     }
 
-    tok->type = SYMACHIN_TTYPE_SYMBOL;
-    tok->text = s;
-
-    if (s == "") return nullptr;
-    else return tok;
+    splits.push_back(e);
+    return splits;
 }
-
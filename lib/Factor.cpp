@@ -2,23 +2,85 @@
  * Implementation of the 'Factor' class.
  */
 
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include "symachin/Factor.h"
 #include "symachin/FactorException.h"
+#include "symachin/FiniteField.h"
 
 using namespace std;
 using namespace symachin;
 
+/**
+ * If true, all numeric factors are reduced modulo
+ * the prime of 'FiniteField'.
+ */
+bool Factor::modularArithmetic = false;
+
+const unsigned int Factor::NO_INDEX;
+
+/**
+ * Name of a symbol, referring to characters stored
+ * elsewhere. The keys of the pool cache refer to the names
+ * of the (never modified) shared factors, so that a name
+ * can be looked up directly in the input, without copying
+ * it into a string.
+ */
+struct name_ref {
+    const char *data;
+    size_t length;
+
+    bool operator==(const name_ref &n) const {
+        return length == n.length && memcmp(data, n.data, length) == 0;
+    }
+};
+struct name_ref_hash {
+    size_t operator()(const name_ref &n) const {
+        // 64-bit FNV-1a hash of the name
+        uint64_t h = 0xCBF29CE484222325ULL;
+        for (size_t i = 0; i < n.length; i++) {
+            h ^= (unsigned char)n.data[i];
+            h *= 0x100000001B3ULL;
+        }
+
+        return (size_t)h;
+    }
+};
+
+/**
+ * Pool of shared symbols (see 'Intern()'), indexed by
+ * sign and name, and a cache of the pool for each thread,
+ * so that looking up a symbol rarely needs the lock.
+ * Each name in the pool is given an index, in the order
+ * the names are first seen.
+ */
+static mutex poolLock;
+static unordered_map<string, FactorPtr> pool[2];
+static unordered_map<string, unsigned int> poolIndices;
+static thread_local unordered_map<name_ref, FactorPtr, name_ref_hash> poolCache[2];
+
 /**
  * Constructor.
  */
 Factor::Factor(const string &name, enum sign s) {
     this->name = name;
     this->sgn = s;
+    this->index = NO_INDEX;
     this->isNumeric = IsNumber(name);
-    if (this->isNumeric)
+    if (this->isNumeric) {
         this->numericValue = GetNumericValue(name, s);
+
+        // Make sure name and sign agree with
+        // the reduced value
+        if (modularArithmetic)
+            SetNumericValue(this->numericValue);
+    }
 }
 /**
  * Copy-constructor.
@@ -26,9 +88,10 @@ Factor::Factor(const string &name, enum sign s) {
 Factor::Factor(const Factor &f) {
     this->name = f.GetName();
     this->sgn = f.GetSign();
+    this->index = f.GetIndex();
     this->isNumeric = f.IsNumber();
     if (this->isNumeric)
-        this->numericValue = GetNumericValue(f);
+        this->numericValue = f.GetNumericValue();
 }
 
 /**
@@ -41,14 +104,30 @@ Factor::~Factor() { }
  * (throws an error if this factor is not
  * a number).
  */
-int Factor::GetNumericValue(const string &name, enum sign s, bool withsign) const {
-    int v = stoi(name);
+long long Factor::GetNumericValue(const string &name, enum sign s, bool withsign) const {
+    long long v;
+
+    if (modularArithmetic) {
+        uint64_t u = 0;
+        for (string::const_iterator it = name.begin(); it != name.end(); it++)
+            u = FiniteField::Add(FiniteField::Multiply(u, 10), (uint64_t)(*it - '0'));
+
+        // Symmetric representative
+        v = NumericSum((long long)u, 0);
+    } else {
+        try {
+            v = stoll(name);
+        } catch (out_of_range&) {
+            throw FactorException("Integer '%s' is too large.", name.c_str());
+        }
+    }
+
     if (withsign && s == SYMACHIN_SIGN_NEG)
         return -v;
     else
         return v;
 }
-int Factor::GetNumericValue(const Factor &f, bool withsign) const {
+long long Factor::GetNumericValue(const Factor &f, bool withsign) const {
     return GetNumericValue(f.GetName(), f.GetSign(), withsign);
 }
 
@@ -56,7 +135,75 @@ int Factor::GetNumericValue(const Factor &f, bool withsign) const {
  * Check if two factors are equal.
  */
 bool Factor::IsEqual(const Factor &f) const {
-    return (this->name == f.GetName());
+    return (this == &f || this->name == f.GetName());
+}
+
+/**
+ * Returns a factor equal to the given factor, to be
+ * stored in a term. Symbols are hash-consed: all terms
+ * containing a symbol (with the same sign) share a single
+ * factor object, which is never modified, so that a term
+ * only stores pointers to its symbols, and equal symbols
+ * usually have the same address. Shared symbols are also
+ * numbered (see 'GetIndex()'), both signs of a symbol
+ * having the same index. Numbers are copied, since they
+ * are modified in place.
+ */
+FactorPtr Factor::Intern(const Factor &f) {
+    if (f.IsNumber())
+        return FactorPtr(new Factor(f));
+
+    unordered_map<name_ref, FactorPtr, name_ref_hash> &cache = poolCache[f.GetSign()];
+    name_ref n = { f.GetName().data(), f.GetName().size() };
+    unordered_map<name_ref, FactorPtr, name_ref_hash>::const_iterator it = cache.find(n);
+    if (it != cache.end())
+        return it->second;
+
+    lock_guard<mutex> guard(poolLock);
+    FactorPtr &p = pool[f.GetSign()][f.GetName()];
+    if (p == nullptr) {
+        p = FactorPtr(new Factor(f));
+        p->index = poolIndices.emplace(f.GetName(), poolIndices.size()).first->second;
+    }
+
+    n.data = p->GetName().data();
+    cache.emplace(n, p);
+    return p;
+}
+/**
+ * Returns the factor with the given name and sign,
+ * as 'Intern()' above, without copying the name unless
+ * it is a number or a symbol not seen before on this
+ * thread.
+ *
+ * name:   Name of the factor (need not be null-terminated).
+ * length: Number of characters in the name.
+ * s:      Sign of the factor.
+ */
+FactorPtr Factor::Intern(const char *name, const size_t length, enum sign s) {
+    bool number = true;
+    for (size_t i = 0; i < length && number; i++)
+        number = (name[i] >= '0' && name[i] <= '9');
+
+    if (!number) {
+        name_ref n = { name, length };
+        unordered_map<name_ref, FactorPtr, name_ref_hash>::const_iterator it = poolCache[s].find(n);
+        if (it != poolCache[s].end())
+            return it->second;
+    }
+
+    return Intern(Factor(string(name, length), s));
+}
+
+/**
+ * Factors are shared between terms until they are
+ * modified (copy-on-write). Replaces the given factor by
+ * a copy of it if it is shared, so that it can be modified
+ * without affecting any other term.
+ */
+void Factor::Unshare(FactorPtr &f) {
+    if (f.use_count() > 1)
+        f = FactorPtr(new Factor(*f));
 }
 
 /**
@@ -111,11 +258,7 @@ void Factor::MultiplyNumeric(const Factor &f) {
     if (!this->isNumeric || !f.IsNumber())
         throw FactorException("Attempting to multiply two non-numeric factors together as numbers.");
 
-    //unsigned int n = stoi(this->name) * stoi(f.GetName());
-    unsigned int n = this->numericValue * f.GetNumericValue();
-    this->name = to_string(n);
-    this->sgn = (this->GetSign()==f.GetSign() ? SYMACHIN_SIGN_POS:SYMACHIN_SIGN_NEG);
-    this->numericValue = n;
+    SetNumericValue(NumericProduct(this->numericValue, f.GetNumericValue()));
 }
 
 /**
@@ -126,6 +269,59 @@ void Factor::Negate() {
     numericValue = -numericValue;
 }
 
+/**
+ * Set the (signed) value of this numeric factor.
+ */
+void Factor::SetNumericValue(const long long v) {
+    this->name = to_string(llabs(v));
+    this->sgn = (v < 0 ? SYMACHIN_SIGN_NEG : SYMACHIN_SIGN_POS);
+    this->numericValue = v;
+}
+
+/**
+ * Multiply two numeric values. In modular mode, the
+ * product is reduced modulo the prime of 'FiniteField'
+ * and returned as the representative closest to zero.
+ * Otherwise, an exception is thrown on overflow.
+ */
+long long Factor::NumericProduct(const long long a, const long long b) {
+    long long p;
+
+    if (modularArithmetic) {
+        uint64_t ua = (a < 0 ? (uint64_t)(a + (long long)FiniteField::PRIME) : (uint64_t)a);
+        uint64_t ub = (b < 0 ? (uint64_t)(b + (long long)FiniteField::PRIME) : (uint64_t)b);
+
+        return NumericSum((long long)FiniteField::Multiply(ua, ub), 0);
+    } else if (__builtin_mul_overflow(a, b, &p))
+        throw FactorException("Integer overflow when multiplying %lld by %lld.", a, b);
+
+    return p;
+}
+
+/**
+ * Add two numeric values. In modular mode, the sum is
+ * reduced modulo the prime of 'FiniteField' and returned
+ * as the representative closest to zero. Otherwise, an
+ * exception is thrown on overflow.
+ */
+long long Factor::NumericSum(const long long a, const long long b) {
+    long long s;
+
+    if (modularArithmetic) {
+        const long long p = (long long)FiniteField::PRIME;
+
+        // |a|, |b| < p, so the sum cannot overflow
+        s = (a + b) % p;
+        if (s > p/2) s -= p;
+        else if (s < -p/2) s += p;
+
+        return s;
+    } else if (__builtin_add_overflow(a, b, &s))
+        throw FactorException("Integer overflow when adding %lld and %lld.", a, b);
+
+    return s;
+}
+
 string Factor::ToString() const {
     //if (this->sgn == SYMACHIN_SIGN_POS)
         return GetName();
@@ -0,0 +1,80 @@
+/**
+ * Implementation of the 'FiniteField' class.
+ */
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include "symachin/FiniteField.h"
+
+using namespace std;
+using namespace symachin;
+
+const uint64_t FiniteField::PRIME;
+
+/**
+ * Mix the bits of the given integer
+ * (finalizer of the SplitMix64 generator).
+ */
+static uint64_t mix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+/**
+ * Reduce the given (signed) integer modulo PRIME.
+ */
+uint64_t FiniteField::FromInteger(const long long v) {
+    if (v >= 0)
+        return ((uint64_t)v) % PRIME;
+    else
+        return Negate(((uint64_t)(-(v+1)) + 1) % PRIME);
+}
+
+/**
+ * Returns the multiplicative inverse of the given
+ * (non-zero) element, computed as a^(p-2).
+ */
+uint64_t FiniteField::Inverse(const uint64_t a) {
+    uint64_t result = 1, base = a;
+    for (uint64_t e = PRIME-2; e > 0; e >>= 1) {
+        if (e & 1)
+            result = Multiply(result, base);
+        base = Multiply(base, base);
+    }
+
+    return result;
+}
+
+/**
+ * Draw a fresh random seed for evaluating
+ * expressions at a random point.
+ */
+uint64_t FiniteField::RandomSeed() {
+    static thread_local mt19937_64 gen(((uint64_t)random_device()() << 32) ^ random_device()());
+    return gen();
+}
+
+/**
+ * Map the given symbol to a pseudo-random field
+ * element. The same name and seed always give the
+ * same value (also across runs and machines), so
+ * that all occurences of a symbol are evaluated at
+ * the same point.
+ *
+ * name: Name of the symbol.
+ * seed: Seed identifying the evaluation point.
+ */
+uint64_t FiniteField::SymbolValue(const string &name, const uint64_t seed) {
+    // 64-bit FNV-1a hash of the name
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (string::const_iterator it = name.begin(); it != name.end(); it++) {
+        h ^= (unsigned char)(*it);
+        h *= 0x100000001B3ULL;
+    }
+
+    h = mix64(h ^ mix64(seed));
+    return (h >> 3) % PRIME;
+}
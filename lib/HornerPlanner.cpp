@@ -0,0 +1,327 @@
+/**
+ * Implementation of the 'HornerPlanner' class.
+ *
+ * The planner turns a polynomial, given as a list of
+ * coefficients and monomials, into a program of simple
+ * arithmetic operations evaluating the polynomial. The
+ * polynomial is written in a nested (multivariate) Horner
+ * form by repeatedly factoring out the power of the symbol
+ * occuring in the most terms,
+ *
+ *   P = x^m * Q + R,
+ *
+ * where neither Q nor R contains any remaining symbol with
+ * a negative power. Every intermediate result is hash-consed,
+ * so that powers, products and sub-expressions occuring in
+ * many places of the tree are only computed once.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "symachin/HornerPlanner.h"
+
+using namespace std;
+using namespace symachin;
+
+const unsigned int HornerPlanner::NONE;
+
+/**
+ * Constructor.
+ *
+ * nslots: Number of symbol slots used by the monomials.
+ */
+HornerPlanner::HornerPlanner(const unsigned int nslots)
+    : divisor(nslots, 0), count(nslots, 0) { }
+
+/**
+ * Comparison and hashing of nodes.
+ */
+bool HornerPlanner::plan_node::operator==(const plan_node &n) const {
+    return (type == n.type && a == n.a && b == n.b && c == n.c &&
+            memcmp(&value, &n.value, sizeof(double)) == 0);
+}
+size_t HornerPlanner::plan_node_hash::operator()(const plan_node &n) const {
+    uint64_t v;
+    memcpy(&v, &n.value, sizeof(double));
+
+    size_t h = hash<uint64_t>()(v);
+    h = h*31 + n.type;
+    h = h*1000003 + n.a;
+    h = h*1000003 + n.b;
+    h = h*1000003 + n.c;
+    return h;
+}
+
+/**
+ * Returns the exponent of the given slot in the given
+ * term, after dividing by the current divisor.
+ */
+unsigned int HornerPlanner::exponent(const unsigned int term, const unsigned int slot) const {
+    const monomial &m = (*monomials)[term];
+    for (monomial::const_iterator it = m.begin(); it != m.end(); it++) {
+        if (it->first == slot)
+            return it->second - divisor[slot];
+    }
+
+    return 0;
+}
+
+/**
+ * Create a node of the given type, or return the
+ * index of an identical, already existing node.
+ */
+unsigned int HornerPlanner::make_node(
+    eval_op::eval_op_type type, unsigned int a, unsigned int b,
+    unsigned int c, double value
+) {
+    // Commutative operations: order operands
+    if ((type == eval_op::ADD || type == eval_op::MUL || type == eval_op::MULADD) && a > b)
+        swap(a, b);
+
+    plan_node n = { type, a, b, c, value };
+    unordered_map<plan_node, unsigned int, plan_node_hash>::const_iterator it = nodeIndex.find(n);
+    if (it != nodeIndex.end())
+        return it->second;
+
+    unsigned int idx = nodes.size();
+    nodes.push_back(n);
+    nodeIndex[n] = idx;
+
+    return idx;
+}
+
+/**
+ * Returns a node representing the given power
+ * of the symbol in the given slot.
+ */
+unsigned int HornerPlanner::power(const unsigned int slot, const unsigned int k) {
+    if (k == 1)
+        return make_node(eval_op::LOAD, slot);
+    else if (k % 2 == 0) {
+        unsigned int h = power(slot, k/2);
+        return make_node(eval_op::MUL, h, h);
+    } else
+        return make_node(eval_op::MUL, power(slot, k-1), power(slot, 1));
+}
+
+/**
+ * Returns a node representing the monomial of the
+ * given term (after dividing by the current divisor),
+ * or 'NONE' if the monomial is 1.
+ */
+unsigned int HornerPlanner::monomial_node(const unsigned int term) {
+    const monomial &m = (*monomials)[term];
+    unsigned int n = NONE;
+
+    for (monomial::const_iterator it = m.begin(); it != m.end(); it++) {
+        unsigned int k = it->second - divisor[it->first];
+        if (k == 0)
+            continue;
+
+        unsigned int p = power(it->first, k);
+        if (n == NONE)
+            n = p;
+        else
+            n = make_node(eval_op::MUL, n, p);
+    }
+
+    return n;
+}
+
+/**
+ * Returns a node representing the plain sum of the
+ * given terms.
+ */
+unsigned int HornerPlanner::sum(vector<unsigned int> &terms) {
+    unsigned int total = NONE;
+
+    for (vector<unsigned int>::const_iterator it = terms.begin(); it != terms.end(); it++) {
+        const double c = (*coefficients)[*it];
+        unsigned int m = monomial_node(*it), t;
+
+        if (m == NONE)
+            t = make_node(eval_op::CONST, 0, 0, 0, c);
+        else if (c == 1.0)
+            t = m;
+        else
+            t = make_node(eval_op::SCALE, m, 0, 0, c);
+
+        if (total == NONE)
+            total = t;
+        else
+            total = make_node(eval_op::ADD, total, t);
+    }
+
+    if (total == NONE)
+        return make_node(eval_op::CONST, 0, 0, 0, 0.0);
+    else
+        return total;
+}
+
+/**
+ * Returns a node representing the given terms
+ * in (multivariate) Horner form.
+ */
+unsigned int HornerPlanner::horner(vector<unsigned int> &terms) {
+    // Count in how many terms each symbol occurs
+    vector<unsigned int> touched;
+    for (vector<unsigned int>::const_iterator it = terms.begin(); it != terms.end(); it++) {
+        const monomial &m = (*monomials)[*it];
+        for (monomial::const_iterator jt = m.begin(); jt != m.end(); jt++) {
+            if (jt->second > divisor[jt->first]) {
+                if (count[jt->first]++ == 0)
+                    touched.push_back(jt->first);
+            }
+        }
+    }
+
+    unsigned int best = NONE, bestCount = 1;
+    for (vector<unsigned int>::const_iterator it = touched.begin(); it != touched.end(); it++) {
+        if (count[*it] > bestCount || (count[*it] == bestCount && best != NONE && *it < best)) {
+            best = *it;
+            bestCount = count[*it];
+        }
+        count[*it] = 0;
+    }
+
+    // No symbol is shared between terms; just sum them
+    if (best == NONE)
+        return sum(terms);
+
+    // Split P = x^m * Q + R
+    vector<unsigned int> Q, R;
+    unsigned int m = NONE;
+    for (vector<unsigned int>::const_iterator it = terms.begin(); it != terms.end(); it++) {
+        unsigned int k = exponent(*it, best);
+        if (k > 0) {
+            Q.push_back(*it);
+            if (k < m) m = k;
+        } else
+            R.push_back(*it);
+    }
+
+    divisor[best] += m;
+    unsigned int q = horner(Q);
+    divisor[best] -= m;
+    vector<unsigned int>().swap(Q);
+
+    unsigned int p = power(best, m);
+    if (R.empty())
+        return make_node(eval_op::MUL, p, q);
+    else
+        return make_node(eval_op::MULADD, p, q, horner(R));
+}
+
+/**
+ * Plan the evaluation of the given polynomial. The
+ * monomials are assumed to be distinct. Returns the
+ * number of registers needed by the program.
+ *
+ * coeffs:    Coefficient of each term.
+ * monoms:    Monomial of each term.
+ * ops:       Vector to store the program in.
+ * outputreg: Set to the register holding the result
+ *            after running the program.
+ */
+unsigned int HornerPlanner::Plan(
+    const vector<double> &coeffs, const vector<monomial> &monoms,
+    vector<eval_op> &ops, unsigned int *outputreg
+) {
+    coefficients = &coeffs;
+    monomials = &monoms;
+
+    vector<unsigned int> terms(coeffs.size());
+    for (unsigned int i = 0; i < terms.size(); i++)
+        terms[i] = i;
+
+    unsigned int root = horner(terms);
+    vector<unsigned int>().swap(terms);
+
+    // Find the nodes that are actually needed, and
+    // the index of the last node using each node
+    const unsigned int nnodes = nodes.size();
+    vector<bool> needed(nnodes, false);
+    vector<unsigned int> lastUse(nnodes, 0);
+    needed[root] = true;
+    lastUse[root] = NONE;
+
+    for (unsigned int i = nnodes; i-- > 0;) {
+        if (!needed[i])
+            continue;
+
+        const plan_node &n = nodes[i];
+        unsigned int nops = 0, operands[3];
+        switch (n.type) {
+            case eval_op::MULADD: operands[nops++] = n.c;
+            case eval_op::ADD:
+            case eval_op::MUL:    operands[nops++] = n.b;
+            case eval_op::SCALE:  operands[nops++] = n.a;
+            default: break;
+        }
+
+        for (unsigned int j = 0; j < nops; j++) {
+            needed[operands[j]] = true;
+            if (lastUse[operands[j]] < i)
+                lastUse[operands[j]] = i;
+        }
+    }
+
+    // Emit operations and allocate registers
+    vector<unsigned int> reg(nnodes, NONE), freeRegs;
+    unsigned int nregs = 0;
+
+    ops.clear();
+    for (unsigned int i = 0; i < nnodes; i++) {
+        if (!needed[i])
+            continue;
+
+        const plan_node &n = nodes[i];
+        eval_op op = { n.type, 0, n.a, n.b, n.c, n.value };
+
+        switch (n.type) {
+            case eval_op::MULADD: op.c = reg[n.c];
+            case eval_op::ADD:
+            case eval_op::MUL:    op.b = reg[n.b];
+            case eval_op::SCALE:  op.a = reg[n.a];
+            default: break;
+        }
+
+        // Release registers of operands which are not
+        // used again (the destination may reuse them)
+        unsigned int operands[3] = { n.a, n.b, n.c }, nops = 0;
+        switch (n.type) {
+            case eval_op::MULADD: nops = 3; break;
+            case eval_op::ADD:
+            case eval_op::MUL:    nops = 2; break;
+            case eval_op::SCALE:  nops = 1; break;
+            default: break;
+        }
+        for (unsigned int j = 0; j < nops; j++) {
+            if (lastUse[operands[j]] == i && reg[operands[j]] != NONE) {
+                freeRegs.push_back(reg[operands[j]]);
+                reg[operands[j]] = NONE;
+            }
+        }
+
+        if (freeRegs.empty())
+            reg[i] = nregs++;
+        else {
+            reg[i] = freeRegs.back();
+            freeRegs.pop_back();
+        }
+
+        op.dest = reg[i];
+        ops.push_back(op);
+    }
+
+    *outputreg = reg[root];
+
+    nodes.clear();
+    nodeIndex.clear();
+
+    return nregs;
+}
@@ -0,0 +1,114 @@
+/**
+ * Implementation of the 'MonomialIndex' class.
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "symachin/Factor.h"
+#include "symachin/MonomialIndex.h"
+#include "symachin/PackedMonomial.h"
+#include "symachin/Term.h"
+
+using namespace std;
+using namespace symachin;
+
+/**
+ * Hash functions of the keys.
+ */
+size_t MonomialIndex::monomial_hash::operator()(const PackedMonomial &m) const {
+    return m.Hash();
+}
+size_t MonomialIndex::indices_hash::operator()(const vector<unsigned int> &v) const {
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (vector<unsigned int>::const_iterator it = v.begin(); it != v.end(); it++)
+        h = (h ^ *it) * 0x100000001B3ULL;
+
+    return (size_t)h;
+}
+
+/**
+ * Returns the sorted indices of the symbols of the
+ * given term. The key is stored in an internal buffer
+ * which is reused by the next call.
+ *
+ * t: Term to generate key for.
+ */
+const vector<unsigned int>& MonomialIndex::key(const Term &t) {
+    vectorFactorPtr facts = t.GetFactors();
+
+    keybuffer.clear();
+    for (vector<FactorPtr>::const_iterator it = facts->begin(); it != facts->end(); it++) {
+        if ((*it)->IsNumber())
+            continue;
+
+        unsigned int i = (*it)->GetIndex();
+        if (i == Factor::NO_INDEX)     // Symbol not interned
+            i = Factor::Intern(*(*it))->GetIndex();
+
+        keybuffer.push_back(i);
+    }
+
+    sort(keybuffer.begin(), keybuffer.end());
+    return keybuffer;
+}
+
+/**
+ * Returns the number of the given key, numbering it
+ * if it has not been seen before.
+ *
+ * table: Table in which to look up the key.
+ * k:     Key to look up.
+ */
+template <class Table>
+size_t MonomialIndex::insert(Table &table, const typename Table::key_type &k) {
+    typename Table::const_iterator it = table.find(k);
+    if (it != table.end())
+        return it->second;
+
+    size_t n = Size();
+    table.emplace(k, n);
+    return n;
+}
+
+/**
+ * Returns the number of the monomial of the given term,
+ * numbering it if it has not been seen before.
+ *
+ * t: Term to look up.
+ */
+size_t MonomialIndex::Insert(const Term &t) {
+    PackedMonomial m(t);
+
+    if (m.IsValid())
+        return insert(packed, m);
+    else
+        return insert(unpacked, key(t));
+}
+
+/**
+ * Insert all monomials of the given index (in no
+ * particular order).
+ *
+ * idx:     Index to insert the monomials of.
+ * numbers: Set to the number in this index of each
+ *          monomial of 'idx', by its number in 'idx'.
+ */
+void MonomialIndex::Insert(const MonomialIndex &idx, vector<size_t> &numbers) {
+    numbers.resize(idx.Size());
+
+    for (unordered_map<PackedMonomial, size_t, monomial_hash>::const_iterator it = idx.packed.begin(); it != idx.packed.end(); it++)
+        numbers[it->second] = insert(packed, it->first);
+    for (unordered_map<vector<unsigned int>, size_t, indices_hash>::const_iterator it = idx.unpacked.begin(); it != idx.unpacked.end(); it++)
+        numbers[it->second] = insert(unpacked, it->first);
+}
+
+/**
+ * Forget all monomials.
+ */
+void MonomialIndex::Clear() {
+    packed.clear();
+    unpacked.clear();
+}
@@ -0,0 +1,476 @@
+/**
+ * Implementation of the 'NativeExpression' class.
+ *
+ * A native expression is evaluated by machine code which
+ * is generated at runtime: C code for the expression is
+ * generated (see 'CodeGenerator'), compiled with the
+ * system C compiler into a shared library, and loaded
+ * with 'dlopen()'. Compiled libraries are kept in a cache
+ * directory, under a name derived from the fingerprint
+ * of the expression, so that the same expression only
+ * needs to be compiled once.
+ *
+ * Since loading a library runs its code, a cache directory
+ * is only used if it belongs to the user and nobody else
+ * can write to it. Otherwise, the library is compiled into
+ * a private temporary directory and removed once loaded.
+ *
+ * The compiler is taken from the environment variable
+ * 'SYMACHIN_CC' (or 'CC'), and defaults to 'cc'. Extra
+ * compiler flags can be given in 'SYMACHIN_CFLAGS'.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "symachin/CodeGenerator.h"
+#include "symachin/CompiledExpression.h"
+#include "symachin/Expression.h"
+#include "symachin/FiniteField.h"
+#include "symachin/NativeExpression.h"
+#include "symachin/SymachinException.h"
+
+using namespace std;
+using namespace symachin;
+
+// Version of the interface between the interpreter
+// and the generated code. Must be changed whenever
+// the generated code changes in an incompatible way.
+#define NATIVE_EXPRESSION_ABI "v1"
+
+/**
+ * Quote the given string for use as a single
+ * argument in a shell command.
+ */
+static string shell_quote(const string &s) {
+    string q = "'";
+    for (string::const_iterator it = s.begin(); it != s.end(); it++) {
+        if (*it == '\'')
+            q += "'\\''";
+        else
+            q += *it;
+    }
+
+    return q + "'";
+}
+
+/**
+ * Create the given directory, along with any missing
+ * parent directories. The directories are only accessible
+ * to the user.
+ */
+static void make_directories(const string &dir) {
+    for (size_t i = 1; i <= dir.size(); i++) {
+        if (i < dir.size() && dir[i] != '/')
+            continue;
+
+        string d = dir.substr(0, i);
+        if (mkdir(d.c_str(), 0700) != 0 && errno != EEXIST)
+            throw SymachinException("Unable to create directory '%s'.", d.c_str());
+    }
+}
+
+/**
+ * Check that the given file (or directory) is owned by the
+ * user and not writable by anyone else, so that nobody else
+ * can have placed a library there. Symbolic links are not
+ * followed.
+ *
+ * path: File to check.
+ * type: Expected type of file ('S_IFDIR' or 'S_IFREG').
+ */
+static bool is_private(const string &path, const mode_t type) {
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0)
+        return false;
+
+    return (st.st_mode & S_IFMT) == type && st.st_uid == geteuid() &&
+           (st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+/**
+ * Create the given cache directory if it does not exist,
+ * and check that it can safely be used (see 'is_private()').
+ */
+static bool use_cache_directory(const string &dir) {
+    try {
+        make_directories(dir);
+    } catch (SymachinException &ex) {
+        return false;
+    }
+
+    return is_private(dir, S_IFDIR);
+}
+
+/**
+ * Constructor. Load the compiled code for the given
+ * expression from the cache directory, or generate and
+ * compile it if it has not been cached.
+ *
+ * expr:     Expression to compile.
+ * cachedir: Directory in which compiled expressions are
+ *           stored. If empty, the default cache directory
+ *           is used (see 'GetDefaultCacheDirectory()').
+ */
+NativeExpression::NativeExpression(const Expression &expr, const string &cachedir) {
+    vector<double> coefficients;
+    vector<monomial> monomials;
+    CompiledExpression::Decompose(expr, symbols, slots, coefficients, monomials);
+
+    sort(symbols.begin(), symbols.end());
+    string allsymbols;
+    for (unsigned int s = 0; s < symbols.size(); s++) {
+        slots[symbols[s]] = s;
+        allsymbols += symbols[s] + '\n';
+    }
+
+    // The fingerprint identifies the expression, and
+    // the symbol list fixes the order of the arguments
+    fingerprint = expr.Fingerprint();
+    char key[64];
+    snprintf(
+        key, sizeof(key), "%016llx-%08llx",
+        (unsigned long long)fingerprint,
+        (unsigned long long)(FiniteField::SymbolValue(allsymbols, fingerprint) & 0xFFFFFFFFULL)
+    );
+
+    string dir = (cachedir.empty() ? GetDefaultCacheDirectory() : cachedir);
+    string name = "/symachin-" NATIVE_EXPRESSION_ABI "-" + string(key) + ".so";
+
+    if (!use_cache_directory(dir)) {
+        compile_private(expr, name);
+        return;
+    }
+
+    library = dir + name;
+    if (load()) {
+        cached = true;
+        return;
+    }
+
+    compile(expr, library);
+
+    if (!load())
+        throw SymachinException("Unable to load compiled expression '%s'.", library.c_str());
+}
+
+/**
+ * Destructor.
+ */
+NativeExpression::~NativeExpression() {
+    unload();
+}
+
+/**
+ * Generate C code for the given expression, with entry
+ * points taking the symbol values as an array.
+ *
+ * expr: Expression to generate code for.
+ */
+string NativeExpression::generate(const Expression &expr) const {
+    CodeGenerator cg("symachin_expression");
+    cg.Add("expression", expr);
+
+    ostringstream os;
+    os << cg.Generate() << endl;
+
+    // Arguments of the generated function, in
+    // terms of the (sorted) symbol slots
+    const vector<string> &cgsymbols = cg.GetSymbols();
+    ostringstream args, bargs;
+    for (unsigned int i = 0; i < cgsymbols.size(); i++) {
+        unsigned int s = slots.at(cgsymbols[i]);
+        args << (i > 0 ? ", " : "") << "sm_x[" << s << "]";
+        bargs << (i > 0 ? ", " : "") << "sm_x[" << s << "][sm_i]";
+    }
+
+    os << "const unsigned long long symachin_fingerprint = 0x" << hex << fingerprint << dec << "ULL;" << endl
+       << "const unsigned int symachin_nsymbols = " << symbols.size() << ";" << endl
+       << endl
+       << "double symachin_evaluate(const double *sm_x) {" << endl
+       << "    (void)sm_x;" << endl
+       << "    return symachin_expression(" << args.str() << ");" << endl
+       << "}" << endl
+       << endl
+       << "void symachin_evaluate_batch(const double *const *sm_x, unsigned long sm_n, double *sm_out) {" << endl
+       << "    unsigned long sm_i;" << endl
+       << "    (void)sm_x;" << endl
+       << "    for (sm_i = 0; sm_i < sm_n; sm_i++)" << endl
+       << "        sm_out[sm_i] = symachin_expression(" << bargs.str() << ");" << endl
+       << "}" << endl;
+
+    return os.str();
+}
+
+/**
+ * Compile the given expression without caching it: the
+ * library is compiled into a new private directory, and
+ * removed (along with the directory) once it is loaded.
+ *
+ * expr: Expression to compile.
+ * name: Name of the library in the directory.
+ */
+void NativeExpression::compile_private(const Expression &expr, const string &name) {
+    const char *tmpdir = getenv("TMPDIR");
+    string tmpl = string(tmpdir != nullptr && *tmpdir != '\0' ? tmpdir : "/tmp") + "/symachin-XXXXXX";
+
+    vector<char> dir(tmpl.begin(), tmpl.end());
+    dir.push_back('\0');
+    if (mkdtemp(dir.data()) == nullptr)
+        throw SymachinException("Unable to create a temporary directory '%s'.", tmpl.c_str());
+
+    library = string(dir.data()) + name;
+
+    bool loaded = false;
+    try {
+        compile(expr, library);
+        loaded = load();
+    } catch (SymachinException &ex) {
+        rmdir(dir.data());
+        throw;
+    }
+
+    remove(library.c_str());
+    rmdir(dir.data());
+
+    if (!loaded)
+        throw SymachinException("Unable to load compiled expression '%s'.", library.c_str());
+}
+
+/**
+ * Generate C code for the given expression and compile
+ * it into a shared library. The library is built under a
+ * temporary name and then moved into place, so that
+ * concurrent runs (and threads) never load a partially
+ * written file.
+ *
+ * expr:    Expression to compile.
+ * outfile: Name of the shared library to create.
+ */
+void NativeExpression::compile(const Expression &expr, const string &outfile) const {
+    static atomic<unsigned long> ncompiled(0);
+
+    if (!IsAvailable())
+        throw SymachinException("No C compiler available (tried '%s').", GetCompiler().c_str());
+
+    string tmp = outfile + "." + to_string(getpid()) + "." + to_string(ncompiled++);
+    string srcfile = tmp + ".c", libfile = tmp + ".so";
+
+    {
+        ofstream f(srcfile);
+        if (!f.is_open())
+            throw SymachinException("Unable to open file for writing: %s.", srcfile.c_str());
+
+        f << generate(expr);
+    }
+
+    const char *cflags = getenv("SYMACHIN_CFLAGS");
+    string cmd =
+        GetCompiler() + " -O2 " + (cflags == nullptr ? "" : string(cflags)+" ") +
+        "-shared -fPIC -o " + shell_quote(libfile) + " " + shell_quote(srcfile) + " 2>&1";
+
+    string output;
+    FILE *p = popen(cmd.c_str(), "r");
+    if (p == nullptr) {
+        remove(srcfile.c_str());
+        throw SymachinException("Unable to run the C compiler: '%s'.", cmd.c_str());
+    }
+
+    char buffer[256];
+    while (fgets(buffer, sizeof(buffer), p) != nullptr)
+        output += buffer;
+
+    int status = pclose(p);
+    remove(srcfile.c_str());
+
+    if (status != 0) {
+        remove(libfile.c_str());
+        throw SymachinException("Compilation of expression failed: '%s':\n%s", cmd.c_str(), output.c_str());
+    }
+
+    if (rename(libfile.c_str(), outfile.c_str()) != 0) {
+        remove(libfile.c_str());
+        throw SymachinException("Unable to move compiled expression to '%s'.", outfile.c_str());
+    }
+}
+
+/**
+ * Load the shared library for this expression, if it
+ * exists, is private to the user (see 'is_private()') and
+ * was compiled for this expression. Returns 'true' on
+ * success.
+ */
+bool NativeExpression::load() {
+    if (!is_private(library, S_IFREG))
+        return false;
+
+    handle = dlopen(library.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (handle == nullptr)
+        return false;
+
+    const unsigned long long *fp = (const unsigned long long*)dlsym(handle, "symachin_fingerprint");
+    const unsigned int *ns = (const unsigned int*)dlsym(handle, "symachin_nsymbols");
+    func = (evaluate_func)dlsym(handle, "symachin_evaluate");
+    batch = (evaluate_batch_func)dlsym(handle, "symachin_evaluate_batch");
+
+    if (fp == nullptr || ns == nullptr || func == nullptr || batch == nullptr ||
+        *fp != fingerprint || *ns != symbols.size()) {
+        unload();
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Unload the shared library of this expression.
+ */
+void NativeExpression::unload() {
+    if (handle != nullptr)
+        dlclose(handle);
+
+    handle = nullptr;
+    func = nullptr;
+    batch = nullptr;
+}
+
+/**
+ * Create a vector of symbol values from the given
+ * table of numeric substitutions, suitable for
+ * passing to 'Evaluate()'.
+ *
+ * subst: Table of numeric substitutions to make.
+ * other: Value to assign to symbols not found in table 'subst'.
+ */
+vector<double> NativeExpression::Bind(const map<string, double> &subst, const double other) const {
+    vector<double> v(symbols.size(), other);
+
+    for (unsigned int s = 0; s < symbols.size(); s++) {
+        map<string, double>::const_iterator it = subst.find(symbols[s]);
+        if (it != subst.end())
+            v[s] = it->second;
+    }
+
+    return v;
+}
+
+/**
+ * Evaluate this expression numerically with the
+ * given table of numeric substitutions.
+ *
+ * subst: Table of numeric substitutions to make.
+ * other: Value to assign to symbols not found in table 'subst'.
+ */
+double NativeExpression::Evaluate(const map<string, double> &subst, const double other) const {
+    return Evaluate(Bind(subst, other));
+}
+
+/**
+ * Evaluate this expression numerically at many points.
+ * The points are split evenly across 'nthreads' threads.
+ *
+ * columns:  Array of 'NumberOfSymbols()' pointers, where
+ *           'columns[s]' points to the values of slot 's'
+ *           at each of the points.
+ * npoints:  Number of points to evaluate at.
+ * out:      Array of length 'npoints' in which to store
+ *           the results.
+ * nthreads: Number of threads to use (0 = one per core).
+ */
+void NativeExpression::Evaluate(
+    const double *const *columns, const size_t npoints,
+    double *out, unsigned int nthreads
+) const {
+    if (nthreads == 0)
+        nthreads = max(1u, thread::hardware_concurrency());
+
+    // No point in having a thread work on less than a block
+    const size_t B = CompiledExpression::BLOCK_SIZE;
+    nthreads = (unsigned int)min((size_t)nthreads, (npoints+B-1) / B);
+
+    if (nthreads <= 1) {
+        batch(columns, npoints, out);
+        return;
+    }
+
+    // Columns offset to the first point of each thread
+    size_t chunk = (npoints + nthreads - 1) / nthreads;
+    vector<vector<const double*>> offsets(nthreads, vector<const double*>(symbols.size()));
+    vector<thread> threads;
+    for (unsigned int i = 0; i < nthreads; i++) {
+        size_t begin = min(npoints, i*chunk), end = min(npoints, (i+1)*chunk);
+        for (unsigned int s = 0; s < symbols.size(); s++)
+            offsets[i][s] = columns[s] + begin;
+
+        if (i > 0)
+            threads.push_back(thread(batch, offsets[i].data(), (unsigned long)(end-begin), out+begin));
+    }
+
+    batch(offsets[0].data(), min(npoints, chunk), out);
+
+    for (vector<thread>::iterator it = threads.begin(); it != threads.end(); it++)
+        it->join();
+}
+
+/**
+ * Returns the command used to invoke the C compiler.
+ */
+string NativeExpression::GetCompiler() {
+    const char *cc = getenv("SYMACHIN_CC");
+    if (cc == nullptr || *cc == '\0')
+        cc = getenv("CC");
+    if (cc == nullptr || *cc == '\0')
+        cc = "cc";
+
+    return cc;
+}
+
+/**
+ * Returns the directory in which compiled expressions
+ * are stored by default. This is '$SYMACHIN_CACHE' if
+ * set, and otherwise the directory 'symachin' in the
+ * user's cache directory (or a directory in '/tmp' named
+ * after the user ID if there is no home directory).
+ */
+string NativeExpression::GetDefaultCacheDirectory() {
+    const char *dir = getenv("SYMACHIN_CACHE");
+    if (dir != nullptr && *dir != '\0')
+        return dir;
+
+    dir = getenv("XDG_CACHE_HOME");
+    if (dir != nullptr && *dir != '\0')
+        return string(dir) + "/symachin";
+
+    dir = getenv("HOME");
+    if (dir != nullptr && *dir != '\0')
+        return string(dir) + "/.cache/symachin";
+
+    return "/tmp/symachin-cache-" + to_string(geteuid());
+}
+
+/**
+ * Returns 'true' if a working C compiler was found.
+ * The check is only done once.
+ */
+bool NativeExpression::IsAvailable() {
+    static int available = -1;
+
+    if (available < 0) {
+        string cmd = GetCompiler() + " --version >/dev/null 2>&1";
+        available = (system(cmd.c_str()) == 0 ? 1 : 0);
+    }
+
+    return (available == 1);
+}
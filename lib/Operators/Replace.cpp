@@ -7,6 +7,7 @@
 #include "symachin/Expression.h"
 #include "symachin/Operators/Replace.h"
 #include "symachin/SymachinException.h"
+#include "symachin/TermAccumulator.h"
 
 using namespace std;
 using namespace symachin;
@@ -65,11 +66,13 @@ void Replace::CreateRule(const std::string &from, const std::string &toexpr) {
  * Note that any term that doesn't contain any of the
  * factors which have rules defined for them, a "zero"
  * rule is automatically defined which eliminates the term.
+ *
+ * Proportional terms of the result are merged, so that
+ * it is in the same form as the sum of its terms.
  */
 ExpressionPtr Replace::Operate(const Expression &expr) const {
-    ExpressionPtr e;
     vectorTermPtr terms = expr.GetTerms();
-    vectorTermPtr newTerms = vectorTermPtr(new vector<TermPtr>());
+    TermAccumulator acc;
 
     for (vector<TermPtr>::const_iterator it = terms->begin(); it != terms->end(); it++) {
         TermPtr trm = *it;
@@ -90,10 +93,11 @@ ExpressionPtr Replace::Operate(const Expression &expr) const {
                 for (vector<TermPtr>::iterator kt = res->begin(); kt != res->end(); kt++) {
                     TermPtr tp = *kt;
                     tp->RemoveFactor(*(rule->from));
-                }
 
-                // Insert terms
-                newTerms->insert(newTerms->end(), res->begin(), res->end());
+                    // Insert term
+                    if (!tp->IsZero())
+                        acc.Add(tp);
+                }
 
                 // Break out of loop to avoid applying
                 // more rules to the same term
@@ -102,6 +106,65 @@ ExpressionPtr Replace::Operate(const Expression &expr) const {
         }
     }
 
-    return ExpressionPtr(new Expression(newTerms));
+    return ExpressionPtr(new Expression(acc.Terms()));
 }
 
+/**
+ * Replace factors in the given expression according
+ * to the set of rules defined in this object (see
+ * 'Operate()'), modifying the expression. Each term is
+ * released as soon as it has been replaced, and when a
+ * factor is replaced by a single term, the term object is
+ * reused (unless it is shared with another expression),
+ * so that only the new terms need to be allocated.
+ *
+ * Since the terms which have been replaced are gone, the
+ * expression cannot be restored if an exception is thrown
+ * (e.g. on overflow). It is then left as a valid, empty
+ * (zero) expression.
+ */
+void Replace::OperateInPlace(Expression &expr) const {
+    vectorTermPtr terms = expr.MoveTerms();
+    TermAccumulator acc;
+
+    try {
+        for (vector<TermPtr>::iterator it = terms->begin(); it != terms->end(); it++) {
+            TermPtr trm;
+            trm.swap(*it);
+
+            // Apply operator to this term
+            for (vector<struct replace_rule*>::const_iterator jt = rules.begin(); jt != rules.end(); jt++) {
+                struct replace_rule *rule = *jt;
+
+                if (rule->to == nullptr)
+                    continue;
+
+                if (trm->HasFactor(*(rule->from))) {
+                    if (rule->to->size() == 1 && trm.use_count() == 1) {
+                        trm->Multiply(*(rule->to->front()));
+                        trm->RemoveFactor(*(rule->from));
+
+                        if (!trm->IsZero())
+                            acc.Add(trm);
+                    } else {
+                        vectorTermPtr res = Expression::Multiply(*trm, *(rule->to));
+
+                        for (vector<TermPtr>::iterator kt = res->begin(); kt != res->end(); kt++) {
+                            (*kt)->RemoveFactor(*(rule->from));
+
+                            if (!(*kt)->IsZero())
+                                acc.Add(*kt);
+                        }
+                    }
+
+                    break;
+                }
+            }
+        }
+
+        expr.SetTerms(acc.Terms());
+    } catch (...) {
+        expr.SetTerms(vectorTermPtr(new vector<TermPtr>()));
+        throw;
+    }
+}
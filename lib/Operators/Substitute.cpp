@@ -0,0 +1,268 @@
+/**
+ * Implementation of the 'Substitute' operator.
+ *
+ * The substitute operator performs partial evaluation:
+ * chosen symbols are replaced by exact rational values,
+ * and terms which become proportional are merged. Since
+ * coefficients are integers, rational values are handled
+ * by multiplying the result by the common denominator of
+ * all terms, which is returned separately. In modular
+ * mode, division is exact and no denominator is needed.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "symachin/Expression.h"
+#include "symachin/Factor.h"
+#include "symachin/FiniteField.h"
+#include "symachin/Operators/Substitute.h"
+#include "symachin/SymachinException.h"
+
+using namespace std;
+using namespace symachin;
+
+/**
+ * Constructor.
+ */
+Substitute::Substitute() {}
+
+/**
+ * Destructor.
+ */
+Substitute::~Substitute() {}
+
+/**
+ * Set the value to substitute for the given symbol.
+ *
+ * symbol:      Name of symbol to substitute.
+ * numerator:   Numerator of the value.
+ * denominator: Denominator of the value.
+ */
+void Substitute::SetValue(const string &symbol, const long long numerator, const long long denominator) {
+    if (denominator == 0)
+        throw SymachinException("Division by zero in value of '%s'.", symbol.c_str());
+
+    long long num = numerator, den = denominator;
+    if (den < 0) {
+        num = -num;
+        den = -den;
+    }
+
+    // Reduce the fraction
+    long long a = llabs(num), b = den;
+    while (b != 0) {
+        long long t = a % b;
+        a = b;
+        b = t;
+    }
+    if (a > 1) {
+        num /= a;
+        den /= a;
+    }
+
+    values[symbol] = make_pair(num, den);
+}
+
+/**
+ * Set the value to substitute for the given symbol
+ * from a string. The value may be an integer ('3'),
+ * a decimal number ('0.25') or a fraction ('-1/3'),
+ * all of which are represented exactly.
+ *
+ * symbol: Name of symbol to substitute.
+ * value:  Value to substitute, as a string.
+ */
+void Substitute::SetValue(const string &symbol, const string &value) {
+    long long parts[2] = {0, 1}, scale[2] = {1, 1};
+    size_t slash = value.find('/');
+    string str[2] = {value.substr(0, slash), (slash == string::npos ? "1" : value.substr(slash+1))};
+
+    for (unsigned int i = 0; i < 2; i++) {
+        string digits;
+        bool point = false;
+
+        for (string::const_iterator it = str[i].begin(); it != str[i].end(); it++) {
+            if (*it == '-' && it == str[i].begin())
+                digits += '-';
+            else if (*it == '.' && !point)
+                point = true;
+            else if (*it >= '0' && *it <= '9') {
+                digits += *it;
+                if (point && __builtin_mul_overflow(scale[i], 10LL, &scale[i]))
+                    throw SymachinException("Too many decimals in value '%s'.", value.c_str());
+            } else
+                throw SymachinException("Invalid numeric value: '%s'.", value.c_str());
+        }
+
+        if (digits.empty() || digits == "-")
+            throw SymachinException("Invalid numeric value: '%s'.", value.c_str());
+
+        try {
+            parts[i] = stoll(digits);
+        } catch (out_of_range &ex) {
+            throw SymachinException("Numeric value out of range: '%s'.", value.c_str());
+        }
+    }
+
+    // (a/s) / (b/t) = (a*t) / (b*s)
+    long long num, den;
+    if (__builtin_mul_overflow(parts[0], scale[1], &num) ||
+        __builtin_mul_overflow(parts[1], scale[0], &den))
+        throw SymachinException("Numeric value out of range: '%s'.", value.c_str());
+
+    SetValue(symbol, num, den);
+}
+
+/**
+ * Substitute the values of this operator into the given
+ * expression. Throws an exception if the result does not
+ * have integer coefficients.
+ *
+ * expr: Expression to substitute values into.
+ */
+ExpressionPtr Substitute::Operate(const Expression &expr) const {
+    long long denominator;
+    ExpressionPtr e = Operate(expr, &denominator);
+
+    if (denominator != 1)
+        throw SymachinException("Substitution gives non-integer coefficients (denominator %lld).", denominator);
+
+    return e;
+}
+
+/**
+ * Substitute the values of this operator into the given
+ * expression. The returned expression is the result
+ * multiplied by 'denominator', which is chosen so that
+ * all coefficients are integers.
+ *
+ * expr:        Expression to substitute values into.
+ * denominator: On return, contains the common denominator
+ *              of the result.
+ */
+ExpressionPtr Substitute::Operate(const Expression &expr, long long *denominator) const {
+    vectorTermPtr terms = expr.GetTerms();
+    const bool modular = Factor::IsModularArithmetic();
+
+    // Value of each symbol as (numerator, denominator). In
+    // modular mode, the division is carried out directly.
+    map<string, pair<long long, long long>> vals = values;
+    if (modular) {
+        for (map<string, pair<long long, long long>>::iterator it = vals.begin(); it != vals.end(); it++) {
+            uint64_t den = FiniteField::FromInteger(it->second.second);
+            if (den == 0)
+                throw SymachinException("Denominator of value of '%s' is zero in modular arithmetic.", it->first.c_str());
+
+            uint64_t v = FiniteField::Multiply(FiniteField::FromInteger(it->second.first), FiniteField::Inverse(den));
+            it->second = make_pair(Factor::NumericSum((long long)v, 0), 1LL);
+        }
+    }
+
+    // Highest power of each substituted symbol
+    map<string, unsigned int> maxPower, power;
+    for (vector<TermPtr>::const_iterator it = terms->begin(); it != terms->end(); it++) {
+        vectorFactorPtr facts = (*it)->GetFactors();
+        power.clear();
+        for (vector<FactorPtr>::const_iterator jt = facts->begin(); jt != facts->end(); jt++) {
+            if (!(*jt)->IsNumber() && vals.count((*jt)->GetName()) > 0) {
+                unsigned int p = ++power[(*jt)->GetName()];
+                maxPower[(*jt)->GetName()] = max(maxPower[(*jt)->GetName()], p);
+            }
+        }
+    }
+
+    long long den = 1;
+    for (map<string, unsigned int>::const_iterator it = maxPower.begin(); it != maxPower.end(); it++) {
+        for (unsigned int k = 0; k < it->second; k++)
+            den = Factor::NumericProduct(den, vals[it->first].second);
+    }
+
+    // Substitute, and merge terms with the same remaining
+    // factors (identified by their sorted names)
+    vector<vectorFactorPtr> remaining;
+    vector<long long> coefficients;
+    unordered_map<string, unsigned int> index;
+    vector<string> names;
+
+    for (vector<TermPtr>::const_iterator it = terms->begin(); it != terms->end(); it++) {
+        vectorFactorPtr facts = (*it)->GetFactors();
+        vectorFactorPtr keep(new vector<FactorPtr>());
+        long long c = (*it)->GetNumericFactorValue();
+
+        power.clear();
+        names.clear();
+        for (vector<FactorPtr>::const_iterator jt = facts->begin(); jt != facts->end(); jt++) {
+            const FactorPtr &f = *jt;
+            if (f->IsNumber())
+                continue;
+            else if (vals.count(f->GetName()) > 0) {
+                c = Factor::NumericProduct(c, vals[f->GetName()].first);
+                power[f->GetName()]++;
+            } else {
+                Factor nf(*f);
+                if (nf.GetSign() == SYMACHIN_SIGN_NEG)
+                    nf.Negate();
+
+                keep->push_back(Factor::Intern(nf));
+                names.push_back(f->GetName());
+            }
+        }
+
+        // Bring all terms to the common denominator
+        for (map<string, unsigned int>::const_iterator jt = maxPower.begin(); jt != maxPower.end(); jt++) {
+            for (unsigned int k = power[jt->first]; k < jt->second; k++)
+                c = Factor::NumericProduct(c, vals[jt->first].second);
+        }
+
+        sort(names.begin(), names.end());
+        string key;
+        for (vector<string>::const_iterator jt = names.begin(); jt != names.end(); jt++)
+            key += *jt + '*';
+
+        unordered_map<string, unsigned int>::const_iterator idx = index.find(key);
+        if (idx == index.end()) {
+            index[key] = coefficients.size();
+            coefficients.push_back(c);
+            remaining.push_back(keep);
+        } else
+            coefficients[idx->second] = Factor::NumericSum(coefficients[idx->second], c);
+    }
+
+    // Remove common factors of the coefficients
+    // and the denominator
+    long long g = den;
+    for (vector<long long>::const_iterator it = coefficients.begin(); it != coefficients.end() && g > 1; it++) {
+        long long a = llabs(*it);
+        while (a != 0) {
+            long long t = g % a;
+            g = a;
+            a = t;
+        }
+    }
+
+    vectorTermPtr newTerms(new vector<TermPtr>());
+    for (unsigned int i = 0; i < coefficients.size(); i++) {
+        long long c = coefficients[i] / g;
+        if (c == 0)
+            continue;
+
+        vectorFactorPtr facts = remaining[i];
+        if (llabs(c) != 1 || facts->empty())
+            facts->push_back(FactorPtr(new Factor(to_string(llabs(c)))));
+
+        TermPtr t(new Term(facts));
+        if (c < 0)
+            t->Negate();
+
+        newTerms->push_back(t);
+    }
+
+    *denominator = den / g;
+    return ExpressionPtr(new Expression(newTerms));
+}
@@ -0,0 +1,143 @@
+/**
+ * Implementation of the 'PackedMonomial' class.
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "symachin/Factor.h"
+#include "symachin/PackedMonomial.h"
+#include "symachin/Term.h"
+
+using namespace std;
+using namespace symachin;
+
+const unsigned int PackedMonomial::WORDS;
+const unsigned int PackedMonomial::FIELD_BITS;
+const unsigned int PackedMonomial::FIELDS_PER_WORD;
+const unsigned int PackedMonomial::MAX_SYMBOLS;
+const unsigned int PackedMonomial::MAX_EXPONENT;
+const uint64_t PackedMonomial::FIELD_MASK;
+const uint64_t PackedMonomial::GUARD;
+
+/**
+ * Constructor. Pack the non-numeric factors of the
+ * given term, with the field of each symbol given by its
+ * index (the monomial is invalid if they do not fit, see
+ * the class description).
+ */
+PackedMonomial::PackedMonomial(const Term &t) {
+    pack(t, nullptr);
+}
+/**
+ * Constructor. Pack the non-numeric factors of the given
+ * term, with the field of each symbol given by its
+ * position in 'slots' (see 'Slots()').
+ */
+PackedMonomial::PackedMonomial(const Term &t, const vector<unsigned int> &slots) {
+    pack(t, &slots);
+}
+
+/**
+ * Pack the non-numeric factors of the given term.
+ *
+ * t:     Term to pack.
+ * slots: Sorted indices of the symbols with a field,
+ *        by field, or 'nullptr' to use the index of each
+ *        symbol as its field.
+ */
+void PackedMonomial::pack(const Term &t, const vector<unsigned int> *slots) {
+    vectorFactorPtr facts = t.GetFactors();
+
+    words[0] = words[1] = 0;
+    for (vector<FactorPtr>::const_iterator it = facts->begin(); it != facts->end(); it++) {
+        if ((*it)->IsNumber())
+            continue;
+
+        unsigned int i = (*it)->GetIndex();
+        if (slots != nullptr) {
+            vector<unsigned int>::const_iterator s = lower_bound(slots->begin(), slots->end(), i);
+            i = (s != slots->end() && *s == i ? (unsigned int)(s - slots->begin()) : MAX_SYMBOLS);
+        }
+
+        if (i >= MAX_SYMBOLS) {
+            *this = Invalid();
+            return;
+        }
+
+        uint64_t &w = words[i / FIELDS_PER_WORD];
+        unsigned int shift = (i % FIELDS_PER_WORD) * FIELD_BITS;
+
+        if (((w >> shift) & FIELD_MASK) == MAX_EXPONENT) {
+            *this = Invalid();
+            return;
+        }
+
+        w += (uint64_t)1 << shift;
+    }
+}
+
+/**
+ * Returns the degree of this (valid) monomial,
+ * i.e. the sum of its exponents.
+ */
+unsigned int PackedMonomial::Degree() const {
+    unsigned int d = 0;
+
+    for (unsigned int i = 0; i < WORDS; i++) {
+        // Sum pairs of fields into bytes (at most
+        // 2*7), then all bytes into the top byte
+        uint64_t w = (words[i] & 0x0F0F0F0F0F0F0F0FULL) + ((words[i] >> 4) & 0x0F0F0F0F0F0F0F0FULL);
+        d += (unsigned int)((w * 0x0101010101010101ULL) >> 56);
+    }
+
+    return d;
+}
+
+/**
+ * Returns a hash of this monomial.
+ */
+size_t PackedMonomial::Hash() const {
+    // Multiply-xorshift, since most monomials only
+    // differ in a few low bits
+    uint64_t h = (words[0] ^ (words[1] * 0x9E3779B97F4A7C15ULL)) * 0xBF58476D1CE4E5B9ULL;
+    return (size_t)(h ^ (h >> 31));
+}
+
+/**
+ * Number the symbols of the given sets of terms afresh,
+ * for packing their monomials independently of the order
+ * in which symbols were interned (see the class
+ * description). Returns the sorted indices of the symbols
+ * given a field, by field: the first 'MAX_SYMBOLS' symbols
+ * found get a field, and terms involving any other symbol
+ * cannot be packed.
+ *
+ * t1, t2: Terms whose symbols to number.
+ */
+vector<unsigned int> PackedMonomial::Slots(const vector<TermPtr> &t1, const vector<TermPtr> &t2) {
+    vector<unsigned int> slots;
+    const vector<TermPtr> *sets[] = { &t1, &t2 };
+
+    for (unsigned int k = 0; k < 2; k++) {
+        for (vector<TermPtr>::const_iterator it = sets[k]->begin(); it != sets[k]->end(); it++) {
+            vectorFactorPtr facts = (*it)->GetFactors();
+            for (vector<FactorPtr>::const_iterator jt = facts->begin(); jt != facts->end(); jt++) {
+                unsigned int i = (*jt)->GetIndex();
+                if ((*jt)->IsNumber() || i == Factor::NO_INDEX)
+                    continue;
+
+                vector<unsigned int>::iterator s = lower_bound(slots.begin(), slots.end(), i);
+                if (s == slots.end() || *s != i) {
+                    if (slots.size() == MAX_SYMBOLS)
+                        return slots;
+
+                    slots.insert(s, i);
+                }
+            }
+        }
+    }
+
+    return slots;
+}
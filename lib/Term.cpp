@@ -3,11 +3,12 @@
  */
 
 #include <iostream>
-#include <algorithm>
+#include <cstdlib>
 #include <map>
 #include <string>
 #include <vector>
 #include "symachin/Factor.h"
+#include "symachin/FiniteField.h"
 #include "symachin/Term.h"
 
 using namespace std;
@@ -17,28 +18,22 @@ using namespace symachin;
  * Constructor.
  */
 Term::Term(const string &s, enum sign sgn) {
-    FactorPtr f(new Factor(s, sgn));
     factors = vectorFactorPtr(new vector<FactorPtr>());
-    factors->push_back(f);
+    factors->push_back(Factor::Intern(Factor(s, sgn)));
 }
 Term::Term(const Factor &f) {
-    FactorPtr fac(new Factor(f));
     factors = vectorFactorPtr(new vector<FactorPtr>());
-    factors->push_back(fac);
+    factors->push_back(Factor::Intern(f));
 }
 Term::Term(vectorFactorPtr f) {
     factors = f;
 }
 /**
- * Copy-constructor.
+ * Copy-constructor. The factors themselves are shared
+ * with the given term (see 'Factor::Unshare()').
  */
 Term::Term(const Term &t) {
-    factors = vectorFactorPtr(new vector<FactorPtr>());
-    vectorFactorPtr f = t.GetFactors();
-
-    for (vector<FactorPtr>::iterator it = f->begin(); it != f->end(); it++) {
-        factors->push_back(FactorPtr(new Factor(*(*it))));
-    }
+    factors = vectorFactorPtr(new vector<FactorPtr>(*t.GetFactors()));
 }
 
 /**
@@ -46,6 +41,17 @@ Term::Term(const Term &t) {
  */
 Term::~Term() { }
 
+/**
+ * Terms are shared between expressions until they are
+ * modified (copy-on-write). Replaces the given term by
+ * a copy of it if it is shared, so that it can be
+ * modified without affecting any other expression.
+ */
+void Term::Unshare(TermPtr &t) {
+    if (t.use_count() > 1)
+        t = TermPtr(new Term(*t));
+}
+
 /**
  * Checks whether the given term is a factor of
  * this term.
@@ -84,7 +90,7 @@ vectorFactorPtr Term::GetNonNumericFactors() const {
     for (vector<FactorPtr>::iterator it = factors->begin(); it != factors->end(); it++) {
         FactorPtr &f = *it;
         if (!f->IsNumber()) {
-            nf->push_back(FactorPtr(new Factor(*f)));
+            nf->push_back(f);
         }
     }
 
@@ -95,11 +101,11 @@ vectorFactorPtr Term::GetNonNumericFactors() const {
  * Return the numeric factor of this term
  * as an integer.
  */
-int Term::GetNumericFactorValue(bool withsign) const {
+long long Term::GetNumericFactorValue(bool withsign) const {
     for (vector<FactorPtr>::iterator it = factors->begin(); it != factors->end(); it++) {
         FactorPtr &f = *it;
         if (f->IsNumber()) {
-            int v = abs(f->GetNumericValue());
+            long long v = llabs(f->GetNumericValue());
             if (!withsign)
                 return v;
 
@@ -166,6 +172,20 @@ bool Term::IsZero() const {
     return false;
 }
 
+/**
+ * Returns the degree of this term, i.e. the
+ * number of non-numeric factors.
+ */
+unsigned int Term::Degree() const {
+    unsigned int d = 0;
+    for (vector<FactorPtr>::const_iterator it = factors->begin(); it != factors->end(); it++) {
+        if (!(*it)->IsNumber())
+            d++;
+    }
+
+    return d;
+}
+
 /**
  * Multiply the given factor with this term.
  */
@@ -175,14 +195,26 @@ void Term::Multiply(const Factor &f) {
     if (f.IsNumber()) {
         for (vector<FactorPtr>::iterator it = factors->begin(); it != factors->end(); it++) {
             if ((*it)->IsNumber()) {
+                Factor::Unshare(*it);
                 (*it)->MultiplyNumeric(f);
                 return;
             }
         }
     }
 
-    FactorPtr fac(new Factor(f));
-    factors->push_back(fac);
+    factors->push_back(Factor::Intern(f));
+}
+
+/**
+ * Multiply the given interned factor (see
+ * 'Factor::Intern()') with this term. A symbol is shared
+ * with the term rather than looked up again.
+ */
+void Term::Multiply(const FactorPtr &f) {
+    if (f->IsNumber())
+        Multiply(*f);
+    else
+        factors->push_back(f);
 }
 
 /**
@@ -191,7 +223,10 @@ void Term::Multiply(const Factor &f) {
 void Term::Multiply(const Term &t) {
     vectorFactorPtr f = t.GetFactors();
     for (vector<FactorPtr>::iterator it = f->begin(); it != f->end(); it++) {
-        Multiply(*(*it));
+        if ((*it)->IsNumber())
+            Multiply(*(*it));
+        else
+            factors->push_back(*it);
     }
 }
 
@@ -199,7 +234,15 @@ void Term::Multiply(const Term &t) {
  * Negate this term.
  */
 void Term::Negate() {
-    (*factors)[0]->Negate();
+    FactorPtr &f = (*factors)[0];
+    if (f->IsNumber()) {
+        Factor::Unshare(f);
+        f->Negate();
+    } else {
+        Factor n(*f);
+        n.Negate();
+        f = Factor::Intern(n);
+    }
 }
 
 /**
@@ -296,7 +339,7 @@ void Term::RemoveFactor(const Factor &f) {
     for (vector<FactorPtr>::iterator it = factors->begin(); it != factors->end(); it++) {
         if ((*it)->IsEqual(f)) {
             enum sign sgn = (*it)->GetSign();
-            factors->erase(remove(factors->begin(), factors->end(), *it), factors->end());
+            factors->erase(it);
 
             // If this was the last factor, push
             // back a factor of unity
@@ -330,6 +373,26 @@ void Term::ReplaceFactors(vectorFactorPtr newfacts) {
     this->factors = newfacts;
 }
 
+/**
+ * Set the numeric pre-factor of this term (including
+ * its sign) to the given non-zero value, keeping all
+ * non-numeric factors.
+ *
+ * v: New value of the numeric pre-factor.
+ */
+void Term::SetNumericFactorValue(const long long v) {
+    vectorFactorPtr nfac = GetNonNumericFactors();
+    if (llabs(v) != 1 || nfac->empty())
+        nfac->push_back(FactorPtr(new Factor(to_string(llabs(v)), (v < 0 ? SYMACHIN_SIGN_NEG : SYMACHIN_SIGN_POS))));
+
+    ReplaceFactors(nfac);
+
+    if ((v > 0 && GetSign() == SYMACHIN_SIGN_NEG) ||
+        (v < 0 && GetSign() == SYMACHIN_SIGN_POS)) {
+        Negate();
+    }
+}
+
 /**
  * Convert this term to a string.
  *
@@ -400,15 +463,44 @@ double Term::Evaluate(const map<string, double>& subst, const double other) cons
 
     for (vector<FactorPtr>::const_iterator it = factors->begin(); it != factors->end(); it++) {
         if ((*it)->IsNumber())
-            total *= (*it)->GetNumericValue();
-        else if (subst.find((*it)->GetName()) != subst.end()) {
-            string s = (*it)->GetName();
-            const double val = subst.at(s);
-            total *= val;
-        } else
-            total *= other;
+            total *= llabs((*it)->GetNumericValue());
+        else {
+            map<string, double>::const_iterator jt = subst.find((*it)->GetName());
+            if (jt != subst.end())
+                total *= jt->second;
+            else
+                total *= other;
+        }
     }
 
-    return total;
+    if (GetSign() == SYMACHIN_SIGN_NEG)
+        return -total;
+    else
+        return total;
 }
 
+/**
+ * Evaluate this term in the finite field of
+ * 'FiniteField', with every symbol replaced by
+ * its pseudo-random value for the given seed.
+ *
+ * seed: Seed identifying the point of evaluation.
+ */
+uint64_t Term::EvaluateModular(const uint64_t seed) const {
+    uint64_t total = 1;
+
+    for (vector<FactorPtr>::const_iterator it = factors->begin(); it != factors->end(); it++) {
+        uint64_t v;
+        if ((*it)->IsNumber())
+            v = FiniteField::FromInteger(llabs((*it)->GetNumericValue()));
+        else
+            v = FiniteField::SymbolValue((*it)->GetName(), seed);
+
+        total = FiniteField::Multiply(total, v);
+    }
+
+    if (GetSign() == SYMACHIN_SIGN_NEG)
+        return FiniteField::Negate(total);
+    else
+        return total;
+}
@@ -0,0 +1,279 @@
+/**
+ * Implementation of the 'TermAccumulator' class.
+ *
+ * A term accumulator sums a stream of terms, merging
+ * proportional terms as it goes. It gives the same result
+ * as adding the terms one by one with 'Expression::Add()',
+ * but finds proportional terms through a hash table (see
+ * 'MonomialIndex'), so that summing N terms takes O(N)
+ * rather than O(N^2) time.
+ *
+ * The order of the terms of a sum depends on the terms
+ * cancelled: a term which cancels and appears again is
+ * moved to the end. Long lists of terms can be summed as
+ * consecutive runs on separate threads (see 'Sum()'),
+ * keeping enough information about each run to place
+ * every term exactly where a serial sum would.
+ */
+
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "symachin/Factor.h"
+#include "symachin/FactorException.h"
+#include "symachin/MonomialIndex.h"
+#include "symachin/Term.h"
+#include "symachin/TermAccumulator.h"
+
+using namespace std;
+using namespace symachin;
+
+const size_t TermAccumulator::NONE;
+
+/**
+ * Add the given term to the sum. The accumulator
+ * takes ownership of the term and may modify it.
+ *
+ * t: Term to add.
+ */
+void TermAccumulator::Add(TermPtr t) {
+    size_t n = index.Insert(*t);
+    if (n == positions.size())
+        positions.push_back(NONE);
+
+    size_t i = positions[n];
+    if (i == NONE) {
+        positions[n] = terms.size();
+        terms.push_back(t);
+        coefficients.push_back(t->GetNumericFactorValue());
+        merged.push_back(false);
+        size++;
+        return;
+    }
+
+    long long sum = Factor::NumericSum(coefficients[i], t->GetNumericFactorValue());
+
+    if (sum == 0) {     // Pre-factor is zero => cancel term
+        terms[i] = nullptr;
+        positions[n] = NONE;
+        size--;
+    } else {
+        coefficients[i] = sum;
+        merged[i] = true;
+    }
+}
+
+/**
+ * Returns the sum of all terms added, and
+ * empties the accumulator.
+ */
+vectorTermPtr TermAccumulator::Terms() {
+    vectorTermPtr result(new vector<TermPtr>());
+    result->reserve(size);
+
+    for (size_t i = 0; i < terms.size(); i++) {
+        if (terms[i] == nullptr)
+            continue;
+
+        if (merged[i]) {
+            Term::Unshare(terms[i]);
+            terms[i]->SetNumericFactorValue(coefficients[i]);
+        }
+
+        result->push_back(terms[i]);
+    }
+
+    terms.clear();
+    coefficients.clear();
+    merged.clear();
+    index.Clear();
+    positions.clear();
+    size = 0;
+
+    return result;
+}
+
+/**
+ * Sum the given runs of terms, as if all terms were
+ * added in order to a single accumulator. Each run is
+ * first summed on its own thread, as if the sum were empty
+ * before it (see 'sum_run()'). The runs are then combined
+ * in order, one monomial at a time: the sum of a monomial
+ * before a run determines whether one of the terms of the
+ * run starts a new term of the result. When it is zero,
+ * the last such term is the one found for the run alone.
+ * Otherwise, a term starts anew only where the partial sum
+ * within the run is its negation, which can only happen if
+ * it lies within the range of partial sums of the run; in
+ * that case, the terms of that monomial in the run are
+ * summed again.
+ *
+ * The runs are summed serially if any term is zero (since
+ * a zero term does not cancel, but starts a zero term), or
+ * if an intermediate sum overflows. The runs are emptied.
+ *
+ * runs: Terms to sum, in order.
+ */
+vectorTermPtr TermAccumulator::Sum(vector<vector<TermPtr>> &runs) {
+    vector<run_sum> sums(runs.size());
+
+    if (runs.size() > 1) {
+        vector<thread> threads;
+        for (size_t r = 1; r < runs.size(); r++)
+            threads.push_back(thread(sum_run, cref(runs[r]), ref(sums[r])));
+
+        sum_run(runs[0], sums[0]);
+
+        for (vector<thread>::iterator it = threads.begin(); it != threads.end(); it++)
+            it->join();
+    }
+
+    bool failed = (runs.size() <= 1);
+    for (vector<run_sum>::const_iterator it = sums.begin(); it != sums.end(); it++) {
+        if (it->error)
+            rethrow_exception(it->error);
+
+        failed = failed || it->failed;
+    }
+
+    // Sum of each monomial, and the positions (run and
+    // term) of its first term in the result and of its
+    // last term
+    MonomialIndex index;
+    vector<long long> total;
+    vector<pair<size_t, size_t>> birth, last;
+
+    for (size_t r = 0; r < runs.size() && !failed; r++) {
+        run_sum &s = sums[r];
+        vector<size_t> numbers;
+        vector<long long> before(s.total.size());
+        vector<bool> replay(s.total.size(), false);
+        bool anyReplay = false;
+
+        index.Insert(s.index, numbers);
+        total.resize(index.Size(), 0);
+        birth.resize(index.Size());
+        last.resize(index.Size());
+
+        try {
+            for (size_t l = 0; l < numbers.size(); l++) {
+                size_t n = numbers[l];
+                long long c = total[n];
+
+                if (c == 0)
+                    birth[n] = make_pair(r, s.birth[l]);
+                else if (c != LLONG_MIN && s.low[l] <= -c && -c <= s.high[l]) {
+                    before[l] = c;
+                    replay[l] = anyReplay = true;
+                }
+
+                total[n] = Factor::NumericSum(c, s.total[l]);
+                last[n] = make_pair(r, s.last[l]);
+            }
+
+            for (size_t i = 0; i < runs[r].size() && anyReplay; i++) {
+                size_t l = s.numbers[i];
+                if (!replay[l])
+                    continue;
+
+                if (before[l] == 0)
+                    birth[numbers[l]] = make_pair(r, i);
+
+                before[l] = Factor::NumericSum(before[l], runs[r][i]->GetNumericFactorValue());
+            }
+        } catch (FactorException&) {
+            failed = true;
+        }
+
+        s = run_sum();
+    }
+
+    if (failed) {
+        TermAccumulator acc;
+        for (vector<vector<TermPtr>>::iterator it = runs.begin(); it != runs.end(); it++) {
+            for (vector<TermPtr>::iterator jt = it->begin(); jt != it->end(); jt++)
+                acc.Add(*jt);
+
+            vector<TermPtr>().swap(*it);
+        }
+
+        return acc.Terms();
+    }
+
+    // Collect the remaining terms in the order they
+    // started
+    vector<vector<pair<size_t, size_t>>> started(runs.size());
+    for (size_t n = 0; n < total.size(); n++) {
+        if (total[n] != 0)
+            started[birth[n].first].push_back(make_pair(birth[n].second, n));
+    }
+
+    vectorTermPtr result(new vector<TermPtr>());
+    for (size_t r = 0; r < runs.size(); r++) {
+        sort(started[r].begin(), started[r].end());
+
+        for (vector<pair<size_t, size_t>>::const_iterator it = started[r].begin(); it != started[r].end(); it++) {
+            size_t n = it->second;
+            TermPtr &t = runs[r][it->first];
+
+            if (last[n] != birth[n]) {
+                Term::Unshare(t);
+                t->SetNumericFactorValue(total[n]);
+            }
+
+            result->push_back(t);
+        }
+
+        vector<TermPtr>().swap(runs[r]);
+    }
+
+    return result;
+}
+
+/**
+ * Sum the given run of terms on its own (see 'Sum()').
+ *
+ * terms: Run of terms to sum.
+ * s:     Set to the sum of the run.
+ */
+void TermAccumulator::sum_run(const vector<TermPtr> &terms, run_sum &s) {
+    s.numbers.reserve(terms.size());
+
+    try {
+        for (size_t i = 0; i < terms.size(); i++) {
+            long long c = terms[i]->GetNumericFactorValue();
+            if (c == 0) {
+                s.failed = true;
+                return;
+            }
+
+            size_t n = s.index.Insert(*terms[i]);
+            s.numbers.push_back(n);
+
+            if (n == s.total.size()) {
+                s.total.push_back(0);
+                s.low.push_back(0);
+                s.high.push_back(0);
+                s.birth.push_back(i);
+                s.last.push_back(i);
+            }
+
+            long long p = s.total[n];
+            if (p == 0)
+                s.birth[n] = i;
+            s.low[n] = min(s.low[n], p);
+            s.high[n] = max(s.high[n], p);
+
+            s.total[n] = Factor::NumericSum(p, c);
+            s.last[n] = i;
+        }
+    } catch (FactorException&) {
+        s.failed = true;
+    } catch (...) {
+        s.error = current_exception();
+    }
+}
@@ -0,0 +1,15 @@
+# Run a script whose assertions hold, and one in which an
+# assertion fails, comparing expressions exactly (the
+# default) and at random points.
+#
+# Usage: cmake -DISYMACHIN=<interpreter> -DSCRIPT=<script> -DFAILING=<script> -P assert.cmake
+
+set(MODES "default|--exact-assert|--random-assert|--random-assert,--assert-points,5|--parallel,--random-assert")
+
+set(EXPECTED_OUTPUT "assertions hold \n")
+include("${CMAKE_CURRENT_LIST_DIR}/check.cmake")
+
+set(SCRIPT "${FAILING}")
+set(EXPECTED_OUTPUT "first assertion holds \nERROR: <script>: line 6:39: Assertion failed. The two expressions are NOT equal.\n")
+set(EXPECTED_RESULT 1)
+include("${CMAKE_CURRENT_LIST_DIR}/check.cmake")
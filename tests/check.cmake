@@ -0,0 +1,50 @@
+# Run the interpreter on a script in each of the given
+# modes, and check that the output is the same in all of
+# them and equal to the expected output. Can be run with
+# 'cmake -P', or included after setting the variables.
+# The interpreter runs in the current directory (the build
+# directory of the tests, when run by ctest).
+#
+# ISYMACHIN:       Interpreter to run.
+# SCRIPT:          Script to run.
+# EXPECTED:        File containing the expected output, or
+# EXPECTED_OUTPUT: the expected output itself.
+# MODES:           Modes to run the script in, separated by
+#                  '|'. The options of a mode are separated by
+#                  ',', and 'default' runs without options.
+# EXPECTED_RESULT: Expected exit status (default: 0).
+#
+# The path of the script is replaced by '<script>' in the
+# output, so that messages can be compared.
+
+if (NOT DEFINED EXPECTED_OUTPUT)
+	file(READ "${EXPECTED}" EXPECTED_OUTPUT)
+endif ()
+if (NOT DEFINED MODES)
+	set(MODES "default")
+endif ()
+if (NOT DEFINED EXPECTED_RESULT)
+	set(EXPECTED_RESULT 0)
+endif ()
+
+string(REPLACE "|" ";" modes "${MODES}")
+
+foreach(mode ${modes})
+	if (mode STREQUAL "default")
+		set(options "")
+	else ()
+		string(REPLACE "," ";" options "${mode}")
+	endif ()
+
+	execute_process(
+		COMMAND "${ISYMACHIN}" ${options} "${SCRIPT}"
+		RESULT_VARIABLE result
+		OUTPUT_VARIABLE output
+		ERROR_VARIABLE output
+	)
+	string(REPLACE "${SCRIPT}" "<script>" output "${output}")
+
+	if (NOT result EQUAL EXPECTED_RESULT OR NOT output STREQUAL EXPECTED_OUTPUT)
+		message(FATAL_ERROR "Unexpected result in mode '${mode}' (${result}):\n${output}")
+	endif ()
+endforeach()
@@ -0,0 +1,70 @@
+# Export an expression whose symbols are keywords or
+# reserved names in C or C++, and check that the generated
+# code compiles as C11, C23 and C++. Then export a long and
+# a short expression, and check that the compiled code gives
+# the values printed by eval.
+#
+# Usage: cmake -DISYMACHIN=<interpreter> -DSCRIPT=<script> -DVALUES=<script>
+#              -DCC=<C compiler> -DCXX=<C++ compiler> -DWORKDIR=<directory>
+#              -P export.cmake
+
+execute_process(
+	COMMAND "${ISYMACHIN}" "${SCRIPT}"
+	WORKING_DIRECTORY "${WORKDIR}"
+	RESULT_VARIABLE result
+	OUTPUT_VARIABLE output
+	ERROR_VARIABLE output
+)
+if (NOT result EQUAL 0)
+	message(FATAL_ERROR "Export failed (${result}):\n${output}")
+endif ()
+
+foreach(compiler "${CC};-std=c11" "${CC};-std=c2x" "${CXX};-x;c++")
+	execute_process(
+		COMMAND ${compiler} -c export.c -o export.o
+		WORKING_DIRECTORY "${WORKDIR}"
+		RESULT_VARIABLE result
+		OUTPUT_VARIABLE output
+		ERROR_VARIABLE output
+	)
+	if (NOT result EQUAL 0)
+		message(FATAL_ERROR "Generated code does not compile with '${compiler}':\n${output}")
+	endif ()
+endforeach()
+
+# The symbols are the arguments in the order w, x, y, z
+set(SCRIPT "${VALUES}")
+set(EXPECTED_OUTPUT "210\n287700\n-1.875\n")
+set(MODES "default|--parallel|--lazy")
+include("${CMAKE_CURRENT_LIST_DIR}/check.cmake")
+
+file(WRITE "${WORKDIR}/exportmain.c"
+	"#include <stdio.h>\n"
+	"void f(const double, const double, const double, const double, double*);\n"
+	"int main(void) {\n"
+	"    double v[2];\n"
+	"    f(0.125, 0.5, 0.25, 2, v);\n"
+	"    printf(\"%g\\n%g\\n\", v[0], v[1]);\n"
+	"    return 0;\n"
+	"}\n"
+)
+execute_process(
+	COMMAND ${CC} exportmain.c exportvalue.c -o exportvalue
+	WORKING_DIRECTORY "${WORKDIR}"
+	RESULT_VARIABLE result
+	OUTPUT_VARIABLE output
+	ERROR_VARIABLE output
+)
+if (NOT result EQUAL 0)
+	message(FATAL_ERROR "Generated code does not compile:\n${output}")
+endif ()
+
+execute_process(
+	COMMAND "${WORKDIR}/exportvalue"
+	RESULT_VARIABLE result
+	OUTPUT_VARIABLE output
+	ERROR_VARIABLE output
+)
+if (NOT result EQUAL 0 OR NOT output STREQUAL "287700\n-1.875\n")
+	message(FATAL_ERROR "Unexpected values of generated code (${result}):\n${output}")
+endif ()
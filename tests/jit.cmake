@@ -0,0 +1,19 @@
+# Run a script which evaluates expressions numerically with
+# the interpreted evaluator and with --jit, using a private
+# cache directory and a world-writable one. Nothing may be
+# cached in the world-writable directory.
+#
+# Usage: cmake -DISYMACHIN=<interpreter> -DSCRIPT=<script> -DEXPECTED=<output> -P jit.cmake
+
+file(REMOVE_RECURSE jitcache unsafecache)
+file(MAKE_DIRECTORY unsafecache)
+execute_process(COMMAND chmod 777 unsafecache)
+
+set(MODES "default|--jit,--jit-cache,jitcache|--jit,--jit-cache,jitcache|--jit,--jit-cache,unsafecache|--parallel,--jit,--jit-cache,unsafecache")
+include("${CMAKE_CURRENT_LIST_DIR}/check.cmake")
+
+file(GLOB cached jitcache/*.so)
+file(GLOB planted unsafecache/*)
+if (NOT cached OR planted)
+	message(FATAL_ERROR "Unexpected cache contents: '${cached}', '${planted}'")
+endif ()
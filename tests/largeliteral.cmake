@@ -0,0 +1,39 @@
+# Run the interpreter on a single literal expression of
+# 90000 terms (which used to overflow the stack), of which
+# 60000 cancel. The literal is written one line at a time.
+#
+# Usage: cmake -DISYMACHIN=<interpreter> -DSCRIPT=<script> -P largeliteral.cmake
+
+file(WRITE "${SCRIPT}" "[A]:\n")
+foreach(i RANGE 299)
+	set(line "")
+	foreach(j RANGE 199)
+		string(APPEND line " + x${i}*y${j}")
+	endforeach()
+	file(APPEND "${SCRIPT}" "${line}\n")
+endforeach()
+foreach(i RANGE 299)
+	set(line "")
+	foreach(j RANGE 99)
+		string(APPEND line " - y${j}*2*x${i} + x${i}*y${j}")
+	endforeach()
+	file(APPEND "${SCRIPT}" "${line}\n")
+endforeach()
+
+file(APPEND "${SCRIPT}"
+	";\n"
+	"printn $A;\n"
+	"[B]: (x0 + y0) * (x0 - y0) - x0*x0 + y0*y0 + $A - $A;\n"
+	"printn $B;\n"
+)
+
+execute_process(
+	COMMAND "${ISYMACHIN}" "${SCRIPT}"
+	RESULT_VARIABLE result
+	OUTPUT_VARIABLE output
+	ERROR_VARIABLE output
+)
+
+if (NOT result EQUAL 0 OR NOT output STREQUAL "30000\n0\n")
+	message(FATAL_ERROR "Unexpected result (${result}):\n${output}")
+endif ()
@@ -0,0 +1,30 @@
+# Run the interpreter on a script which updates the same
+# label with 50000 statements, so that evaluating the label
+# lazily forces a chain of 50000 thunks (which used to
+# overflow the stack). The second script never uses the
+# chain, which is released when the interpreter exits.
+#
+# Usage: cmake -DISYMACHIN=<interpreter> -DSCRIPT=<script> -P lazychain.cmake
+
+set(line "")
+foreach(i RANGE 99)
+	string(APPEND line "[A]: $A + y;\n")
+endforeach()
+
+foreach(used TRUE FALSE)
+	file(WRITE "${SCRIPT}" "[A]: x;\n")
+	foreach(i RANGE 499)
+		file(APPEND "${SCRIPT}" "${line}")
+	endforeach()
+
+	if (used)
+		file(APPEND "${SCRIPT}" "print $A;\n")
+		set(EXPECTED_OUTPUT "x  +  y * 50000 \n")
+	else ()
+		file(APPEND "${SCRIPT}" "print x;\n")
+		set(EXPECTED_OUTPUT "x \n")
+	endif ()
+
+	set(MODES "default|--lazy|--parallel,--lazy|--lazy,--free-labels")
+	include("${CMAKE_CURRENT_LIST_DIR}/check.cmake")
+endforeach()
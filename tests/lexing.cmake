@@ -0,0 +1,26 @@
+# Run a script with comments and strings which includes an
+# empty file and a file not ending in a newline, and read
+# it from a pipe as well, which cannot be memory-mapped.
+#
+# Usage: cmake -DISYMACHIN=<interpreter> -DSCRIPT=<script> -DEXPECTED=<output> -P lexing.cmake
+
+file(WRITE lexingempty.sm "")
+file(WRITE lexinginclude.sm
+	"/* included file */\n"
+	"[I]: b*c - d;\n"
+	"print \"included\" $I; # no newline at the end"
+)
+
+set(MODES "default|--parallel|--lazy")
+include("${CMAKE_CURRENT_LIST_DIR}/check.cmake")
+
+execute_process(
+	COMMAND "${ISYMACHIN}" /dev/stdin
+	INPUT_FILE "${SCRIPT}"
+	RESULT_VARIABLE result
+	OUTPUT_VARIABLE output
+	ERROR_VARIABLE output
+)
+if (NOT result EQUAL 0 OR NOT output STREQUAL EXPECTED_OUTPUT)
+	message(FATAL_ERROR "Unexpected result when reading from a pipe (${result}):\n${output}")
+endif ()
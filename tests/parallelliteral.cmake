@@ -0,0 +1,26 @@
+# Run the interpreter on a literal expression of a few
+# megabytes, which is parsed and summed in chunks when
+# using several threads. Two terms cancel and appear again
+# in every block of the literal, swapping their order half
+# way, so the result depends on summing the chunks exactly
+# as a serial sum would.
+#
+# Usage: cmake -DISYMACHIN=<interpreter> -DSCRIPT=<script> -P parallelliteral.cmake
+
+file(WRITE "${SCRIPT}" "[A]: x*y + x*x\n")
+foreach(block " - x*y + z + x*y - x*x + x*x" " - x*x + z + x*x - x*y + x*y")
+	set(line "")
+	foreach(i RANGE 99)
+		string(APPEND line "${block}")
+	endforeach()
+	set(line "${line}\n")
+
+	foreach(i RANGE 599)
+		file(APPEND "${SCRIPT}" "${line}")
+	endforeach()
+endforeach()
+file(APPEND "${SCRIPT}" ";\nprint $A;\n")
+
+set(EXPECTED_OUTPUT "z * 120000  +  x * x  +  x * y \n")
+set(MODES "--threads,1|--threads,2|--threads,4|--parallel,--threads,3")
+include("${CMAKE_CURRENT_LIST_DIR}/check.cmake")
@@ -0,0 +1,60 @@
+# Run a script with --script-cache several times, and check
+# that the cache is kept up to date when an included file
+# changes, when the cache is damaged and when the mode
+# changes. The script is copied to the current directory, so
+# that the cache is not written to the source tree.
+#
+# Usage: cmake -DISYMACHIN=<interpreter> -DSCRIPT=<script> -P scriptcache.cmake
+
+configure_file("${SCRIPT}" scriptcache.sm COPYONLY)
+set(SCRIPT scriptcache.sm)
+set(cachefile scriptcache.sm.smc)
+file(REMOVE ${cachefile})
+
+# Run the script in the given modes, and return the hash of
+# the cache written
+function(check_cache modes expected hash)
+	set(MODES "${modes}")
+	set(EXPECTED_OUTPUT "${expected}")
+	include("${CMAKE_CURRENT_LIST_DIR}/check.cmake")
+	if (NOT EXISTS ${cachefile})
+		message(FATAL_ERROR "No cache written in modes '${modes}'")
+	endif ()
+	file(SHA256 ${cachefile} h)
+	set(${hash} ${h} PARENT_SCOPE)
+endfunction()
+
+string(CONCAT first
+	"a * a  -  b * b  +  2 * a * b \n"
+	"a * c  +  a * 1  +  2 * b * c  +  2 * b \n"
+	"a * 3  +  b * 6 \n"
+)
+string(CONCAT second
+	"-b * b  +  a * b \n"
+	"b * c  +  b * 1 \n"
+	"b * 3 \n"
+)
+
+file(WRITE scriptcacheinclude.sm "[I]: 2*a*b;\n")
+check_cache("default|--script-cache|--script-cache|--script-cache,--parallel|--script-cache,--lazy" "${first}" hash1)
+
+# A changed included file is read again
+file(WRITE scriptcacheinclude.sm "[I]: 0 - a*a + a*b;\n")
+check_cache("--script-cache|--script-cache,--lazy" "${second}" hash2)
+if (hash1 STREQUAL hash2)
+	message(FATAL_ERROR "Cache not updated after a change of an included file")
+endif ()
+
+# A damaged cache is replaced
+file(WRITE ${cachefile} "SMCACHE3 damaged")
+check_cache("--script-cache" "${second}" hash3)
+if (NOT hash3 STREQUAL hash2)
+	message(FATAL_ERROR "Damaged cache not replaced")
+endif ()
+
+# A cache written in modular mode is not used otherwise
+check_cache("--modular,--script-cache" "${second}0 of 0 assertions failed in modular mode.\n" hash4)
+check_cache("--script-cache" "${second}" hash5)
+if (hash4 STREQUAL hash2 OR NOT hash5 STREQUAL hash2)
+	message(FATAL_ERROR "Cache not replaced after a change of mode")
+endif ()
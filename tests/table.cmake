@@ -0,0 +1,47 @@
+# Run a script which evaluates an expression, and its
+# gradient, at all points of a table of 300 rows (more than
+# one block of points), and check the tables of values
+# written in each mode.
+#
+# Usage: cmake -DISYMACHIN=<interpreter> -DSCRIPT=<script> -P table.cmake
+
+# x*x*y + 3*x - y*z with z = 1, and twice that plus one,
+# which is read from the first table of values
+set(points "# x,y\n\nx,y\n")
+set(expected "value\n")
+set(doubled "value\n")
+set(gradient "value,d/dx,d/dy,d/dz\n")
+foreach(i RANGE 299)
+	math(EXPR x "${i} % 50")
+	math(EXPR y "${i} % 7")
+	math(EXPR value "${x}*${x}*${y} + 3*${x} - ${y}")
+	math(EXPR twice "2*${value} + 1")
+	string(APPEND points "${x},${y}\n")
+	string(APPEND expected "${value}\n")
+	string(APPEND doubled "${twice}\n")
+	math(EXPR dx "2*${x}*${y} + 3")
+	math(EXPR dy "${x}*${x} - 1")
+	math(EXPR dz "0 - ${y}")
+	string(APPEND gradient "${value},${dx},${dy},${dz}\n")
+endforeach()
+file(WRITE tablepoints.csv "${points}")
+
+set(EXPECTED_OUTPUT "tables written \n")
+foreach(mode "default" "--threads,1" "--threads,4" "--jit,--jit-cache,tablecache" "--parallel,--threads,4" "--lazy")
+	file(REMOVE tablevalues.csv tabledoubled.csv tablegradient.csv)
+	set(MODES "${mode}")
+	include("${CMAKE_CURRENT_LIST_DIR}/check.cmake")
+
+	file(READ tablevalues.csv output)
+	if (NOT output STREQUAL expected)
+		message(FATAL_ERROR "Unexpected values in mode '${mode}':\n${output}")
+	endif ()
+	file(READ tabledoubled.csv output)
+	if (NOT output STREQUAL doubled)
+		message(FATAL_ERROR "Unexpected second table in mode '${mode}':\n${output}")
+	endif ()
+	file(READ tablegradient.csv output)
+	if (NOT output STREQUAL gradient)
+		message(FATAL_ERROR "Unexpected gradient in mode '${mode}':\n${output}")
+	endif ()
+endforeach()
@@ -10,7 +10,7 @@ endif
 let b:current_syntax = "symachin"
 
 " Keywords
-syn keyword symachinKeyword apply assert by define end eval group in include other print printf printn replace to with
+syn keyword symachinKeyword apply assert by define end eval export group in include other print printf printn replace substitute to with wrt
 " Operators
 syn match symachinOperator '->\|+\|-\|*\|=\|:\|;'
 